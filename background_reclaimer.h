@@ -0,0 +1,158 @@
+#ifndef BACKGROUND_RECLAIMER_H
+#define BACKGROUND_RECLAIMER_H
+
+//  destroys released buffers on a background thread, so dropping the last
+//  copy of a large vector does not stall the caller
+//  the queue is bounded, a block that does not fit is destroyed in place
+
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vector.h"
+
+class background_reclaimer {
+ public:
+  using reclaim_t = void (*)(char*) noexcept;
+
+  static constexpr size_t const QUEUE_CAPACITY = 256;
+
+  //  false if the queue is full or the reclaimer is shut down
+  static bool defer(reclaim_t reclaim, char* block) noexcept {
+    if (closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    return instance().push(reclaim, block);
+  }
+
+  //  waits until every block deferred so far is destroyed
+  static void flush() {
+    if (!closed_.load(std::memory_order_acquire)) {
+      instance().wait_idle();
+    }
+  }
+
+  //  destroys the queued blocks and stops the thread,
+  //  the next deferred block starts it again
+  static void drain() {
+    if (!closed_.load(std::memory_order_acquire)) {
+      instance().stop();
+    }
+  }
+
+  background_reclaimer(background_reclaimer const&) = delete;
+  background_reclaimer& operator=(background_reclaimer const&) = delete;
+
+ private:
+
+  struct entry {
+    reclaim_t reclaim;
+    char* block;
+  };
+
+  //  trivially destructible, so it is readable after the instance is
+  //  destroyed at exit, blocks released later are destroyed in place
+  static inline std::atomic<bool> closed_{false};
+
+  std::mutex mutex_;
+  std::mutex control_;
+  std::condition_variable ready_;
+  std::condition_variable idle_;
+  std::vector<entry> queue_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+  size_t busy_ = 0;
+  bool stopping_ = false;
+  std::thread worker_;
+
+  background_reclaimer() : queue_(QUEUE_CAPACITY) {
+  }
+
+  ~background_reclaimer() {
+    closed_.store(true, std::memory_order_release);
+    stop();
+  }
+
+  static background_reclaimer& instance() {
+    static background_reclaimer reclaimer;
+    return reclaimer;
+  }
+
+  bool push(reclaim_t reclaim, char* block) noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || count_ == queue_.size()) {
+      return false;
+    }
+    if (!worker_.joinable()) {
+      try {
+        worker_ = std::thread([this] { run(); });
+      } catch (...) {
+        return false;
+      }
+    }
+    queue_[(head_ + count_) % queue_.size()] = {reclaim, block};
+    ++count_;
+    ready_.notify_one();
+    return true;
+  }
+
+  void run() noexcept {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ready_.wait(lock, [this] { return stopping_ || count_ != 0; });
+      if (count_ == 0) {
+        return;
+      }
+      entry e = queue_[head_];
+      head_ = (head_ + 1) % queue_.size();
+      --count_;
+      ++busy_;
+      lock.unlock();
+      e.reclaim(e.block);
+      lock.lock();
+      --busy_;
+      if (count_ == 0 && busy_ == 0) {
+        idle_.notify_all();
+      }
+    }
+  }
+
+  void wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return count_ == 0 && busy_ == 0; });
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> control(control_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      ready_.notify_all();
+    }
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = false;
+  }
+};
+
+//  a reference counting policy destroying released blocks of Threshold
+//  bytes or more on the background reclaimer, Base counts the references
+template <typename Base = atomic_ref_count,
+        size_t Threshold = (size_t(1) << 20)>
+struct deferred_release : Base {
+  static bool defer(void (*reclaim)(char*) noexcept, char* block,
+                    size_t bytes) noexcept {
+    return bytes >= Threshold && background_reclaimer::defer(reclaim, block);
+  }
+};
+
+//  opt-in, dropping the last copy of a large buffer costs a queue push
+template <typename T>
+using deferred_vector = vector<T, 1, deferred_release<>>;
+
+#endif //BACKGROUND_RECLAIMER_H
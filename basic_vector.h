@@ -6,34 +6,207 @@
 #define BASIC_VECTOR_H
 
 #include <cstddef>
+#include <cstring>
 #include <utility>
 #include <algorithm>
 #include <memory>
+#include <type_traits>
+#include <atomic>
 #include <cassert>
 #include <iostream>
 
-template <typename T, size_t _INITIAL_CAPACITY = 4>
+#include "byte_compare.h"
+#include "parallel_construct.h"
+
+//  objects of such types may be moved by copying their bytes and
+//  forgetting the source, specialize for types like std::unique_ptr
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {
+};
+
+template <typename T>
+constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+//  allocators with reallocate(p, old_n, n) resize a block keeping its bytes,
+//  possibly moving it, see mremap_allocator
+template <typename Alloc, typename = void>
+struct has_reallocate : std::false_type {
+};
+
+template <typename Alloc>
+struct has_reallocate<Alloc, std::void_t<decltype(std::declval<Alloc&>().
+        reallocate(std::declval<typename std::allocator_traits<Alloc>::
+                   pointer>(), size_t(), size_t()))>> : std::true_type {
+};
+
+//  reference counting policies for the shared buffer
+
+//  a policy with defer(reclaim, block, bytes) may take over destroying
+//  a released block, reclaim(block) is to be called later, see
+//  deferred_release, false has the block destroyed right away
+template <typename RefCount, typename = void>
+struct has_deferred_release : std::false_type {
+};
+
+template <typename RefCount>
+struct has_deferred_release<RefCount, std::void_t<decltype(RefCount::defer(
+        std::declval<void (*)(char*) noexcept>(), std::declval<char*>(),
+        size_t()))>> : std::true_type {
+};
+
+//  single-threaded, buffers may not be shared between threads
+struct plain_ref_count {
+  using counter = size_t;
+
+  static void init(counter& c) noexcept {
+    c = 1;
+  }
+
+  static size_t load(counter const& c) noexcept {
+    return c;
+  }
+
+  static void retain(counter& c) noexcept {
+    ++c;
+  }
+
+  //  true if the last reference was released
+  static bool release(counter& c) noexcept {
+    return !(--c);
+  }
+};
+
+//  copies sharing a buffer may live in different threads
+struct atomic_ref_count {
+  using counter = std::atomic<size_t>;
+
+  static void init(counter& c) noexcept {
+    c.store(1, std::memory_order_relaxed);
+  }
+
+  //  acquire, so a unique owner sees all writes of the released copies
+  static size_t load(counter const& c) noexcept {
+    return c.load(std::memory_order_acquire);
+  }
+
+  static void retain(counter& c) noexcept {
+    c.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static bool release(counter& c) noexcept {
+    return c.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+};
+
+//  growth policies, grow returns the capacity of a grown block,
+//  at least required, for blocks of header + capacity * element bytes
+
+struct doubling_growth {
+  static size_t grow(size_t capacity, size_t required, size_t, size_t) noexcept {
+    return std::max(2 * capacity, required);
+  }
+};
+
+//  blocks freed while growing may add up to a new one
+struct one_and_half_growth {
+  static size_t grow(size_t capacity, size_t required, size_t, size_t) noexcept {
+    return std::max(capacity + capacity / 2, required);
+  }
+};
+
+//  rounds the capacity chosen by Base up to fill the block to the end of
+//  its size class: 16 byte steps up to 128 bytes, then four classes per
+//  power of two, as in jemalloc and close to tcmalloc and glibc bins
+template <typename Base = doubling_growth>
+struct size_class_growth {
+  static size_t grow(size_t capacity, size_t required, size_t header,
+                     size_t element) noexcept {
+    size_t cap = Base::grow(capacity, required, header, element);
+    return (size_class(header + cap * element) - header) / element;
+  }
+
+  static size_t size_class(size_t bytes) noexcept {
+    if (bytes <= 128) {
+      return (bytes + 15) & ~size_t(15);
+    }
+    size_t top = size_t(1) << (sizeof(size_t) * 8 - 1);
+    while (!(top & (bytes - 1))) {
+      top >>= 1;
+    }
+    size_t step = top / 4;
+    return (bytes + step - 1) & ~(step - 1);
+  }
+};
+
+//  a common cache line, the DataAlign for data free of false sharing
+constexpr size_t const cache_line_size = 64;
+
+//  saves a buffer to a file and maps it back, see mapped_file.h
+template <typename Buffer>
+struct mapped_file;
+
+//  the header and the elements share one block obtained from Allocator,
+//  the block keeps a copy of the allocator unless it is empty
+//  elements start at a multiple of max(alignof(T), DataAlign),
+//  over-aligned blocks come from the allocator's aligned allocation
+template <typename T, size_t _INITIAL_CAPACITY = 4,
+        typename RefCount = plain_ref_count,
+        typename Allocator = std::allocator<T>,
+        typename Growth = doubling_growth,
+        size_t DataAlign = alignof(T)>
 struct basic_vector {
   using iterator = T*;
   using const_iterator = T const*;
+  using allocator_type = Allocator;
 
-  basic_vector() : data_(allocate(INITIAL_CAPACITY)) {
-    size() = 0;
-    ref_count() = 1;
+  explicit basic_vector(Allocator const& alloc = Allocator())
+          : data_(allocate(INITIAL_CAPACITY, alloc_t(alloc))) {
   }
 
+  //  a writer through a pointer taken before breaks copy-on-write anyway,
+  //  so the shared block may cache its hash again
   basic_vector(basic_vector const& other) noexcept : data_(other.data_) {
-    ++ref_count();
+    header_t* h = header(data_);
+    RefCount::retain(h->ref_count);
+    if (mapped(data_)) {
+      RefCount::retain(h->ref_count);
+    }
+    size_t exposed = EXPOSED;
+    if (h->hash.load(std::memory_order_relaxed) == EXPOSED) {
+      h->hash.compare_exchange_strong(exposed, 0, std::memory_order_relaxed);
+    }
+  }
+
+  //  shares the block of other, releasing ours
+  basic_vector& operator=(basic_vector const& other) noexcept {
+    basic_vector copy(other);
+    swap(copy);
+    return *this;
+  }
+
+  void swap(basic_vector& other) noexcept {
+    std::swap(data_, other.data_);
   }
 
   template <typename S, typename =
   std::enable_if_t<std::is_convertible_v<S, T>>>
-  explicit basic_vector(S&& val) : basic_vector() {
+  explicit basic_vector(S&& val, Allocator const& alloc = Allocator())
+          : basic_vector(alloc) {
     push_back(std::forward<S>(val));
   }
 
+  static basic_vector with_capacity(size_t cap,
+                                    Allocator const& alloc = Allocator()) {
+    return basic_vector(allocate(std::max(INITIAL_CAPACITY, cap),
+                                 alloc_t(alloc)));
+  }
+
+  Allocator get_allocator() const noexcept {
+    return Allocator(header(data_)->alloc);
+  }
+
   size_t capacity(char const* p) const noexcept {
-    return *reinterpret_cast<size_t const*>(p);
+    return header(p)->capacity & ~MAPPED;
   }
 
   size_t capacity() const noexcept {
@@ -41,7 +214,7 @@ struct basic_vector {
   }
 
   size_t size(char const* p) const noexcept {
-    return *(reinterpret_cast<size_t const*>(p) + 1);
+    return header(p)->size;
   }
 
   size_t size() const noexcept {
@@ -49,13 +222,18 @@ struct basic_vector {
   }
 
   size_t ref_count(char const* p) const noexcept {
-    return *(reinterpret_cast<size_t const*>(p) + 2);
+    return RefCount::load(header(p)->ref_count);
   }
 
   size_t ref_count() const noexcept {
     return ref_count(data_);
   }
 
+  //  ours alone and writable, a mapped file never is, see MAPPED
+  bool unique() const noexcept {
+    return ref_count() == 1;
+  }
+
   iterator begin(char* p) noexcept {
     return reinterpret_cast<T*>(p + DATA_SHIFT);
   }
@@ -64,7 +242,13 @@ struct basic_vector {
     return reinterpret_cast<T const*>(p + DATA_SHIFT);
   }
 
+  //  elements may change through the result at any later time,
+  //  so hash() stops caching for this block until it is copied
   iterator begin() noexcept {
+    auto& cached = header(data_)->hash;
+    if (cached.load(std::memory_order_relaxed) != EXPOSED) {
+      cached.store(EXPOSED, std::memory_order_relaxed);
+    }
     return begin(data_);
   }
 
@@ -72,22 +256,124 @@ struct basic_vector {
     return begin(data_);
   }
 
+  //  computed once per block and kept in the header until the next
+  //  change, not kept while begin() may have handed out a writable pointer
+  size_t hash() const {
+    auto& cached = header(data_)->hash;
+    size_t result = cached.load(std::memory_order_relaxed);
+    if (result == 0 || result == EXPOSED) {
+      size_t expected = 0;
+      bool caching = result == 0;
+      result = hash_range(begin(), size());
+      if (caching) {
+        cached.compare_exchange_strong(expected, result,
+                                       std::memory_order_relaxed);
+      }
+    }
+    return result;
+  }
+
+  //  a shared block is copied and grown in one step if needed
   template <typename... Args>
   void emplace_back(Args&& ... args) {
-    if (size() != capacity()) {
-      new(begin() + size()) T(std::forward<Args>(args)...);
-    } else {
-      char* new_data = make_copy(std::max(INITIAL_CAPACITY, 2 * capacity()));
-      try {
-        new(begin(new_data) + size()) T(std::forward<Args>(args)...);
-      } catch (...) {
-        revert(new_data, std::__move_if_noexcept_cond<T>());
-        throw;
+    if (size() != capacity() && unique()) {
+      new(begin_write() + size()) T(std::forward<Args>(args)...);
+      ++size();
+      return;
+    }
+    insert_realloc(size(), 1, [&](T* dst, size_t, size_t) {
+      new(dst) T(std::forward<Args>(args)...);
+    });
+  }
+
+  //  appends n value-initialized elements
+  void append(size_t n) {
+    append_n<false>(n, in_parallel([](T* dst, size_t, size_t count) {
+      std::uninitialized_value_construct_n(dst, count);
+    }));
+  }
+
+  void append(size_t n, T const& val) {
+    append_n(n, in_parallel([&](T* dst, size_t, size_t count) {
+      std::uninitialized_fill_n(dst, count, val);
+    }));
+  }
+
+  //  appends n elements left indeterminate, only the size is bumped
+  void append_uninitialized(size_t n) {
+    static_assert(std::is_trivially_default_constructible_v<T>);
+    append_n<false>(n, [](T*, size_t, size_t) {
+    });
+  }
+
+  //  insertions work on shared blocks too, making a copy
+  //  of the new layout in one pass
+
+  template <typename... Args>
+  void emplace(size_t pos, Args&& ... args) {
+    assert(pos <= size());
+    if (!unique() || size() == capacity()) {
+      insert_realloc(pos, 1, [&](T* dst, size_t, size_t) {
+        new(dst) T(std::forward<Args>(args)...);
+      });
+      return;
+    }
+    T tmp(std::forward<Args>(args)...);
+    insert_in_place(pos, 1, [&](T* dst, size_t, size_t count) {
+      if (count) {
+        new(dst) T(std::move(tmp));
       }
-      destroy_self();
-      data_ = new_data;
+    }, [&](T* dst, size_t, size_t count) {
+      if (count) {
+        *dst = std::move(tmp);
+      }
+    });
+  }
+
+  void insert(size_t pos, size_t n, T const& val) {
+    assert(pos <= size());
+    if (!n) {
+      return;
+    }
+    if (!unique() || size() + n > capacity()) {
+      insert_realloc(pos, n, in_parallel([&](T* dst, size_t, size_t count) {
+        std::uninitialized_fill_n(dst, count, val);
+      }));
+      return;
+    }
+    T tmp(val);
+    insert_in_place(pos, n, [&](T* dst, size_t, size_t count) {
+      std::uninitialized_fill_n(dst, count, tmp);
+    }, [&](T* dst, size_t, size_t count) {
+      std::fill_n(dst, count, tmp);
+    });
+  }
+
+  //  [first, last) must not point into this block
+  template <typename ForwardIterator>
+  void insert(size_t pos, ForwardIterator first, ForwardIterator last) {
+    assert(pos <= size());
+    size_t n = std::distance(first, last);
+    if (!n) {
+      return;
     }
-    ++size();
+    auto construct = [&](T* dst, size_t from, size_t count) {
+      std::uninitialized_copy_n(std::next(first, from), count, dst);
+    };
+    if (!unique() || size() + n > capacity()) {
+      using category = typename std::iterator_traits<
+              ForwardIterator>::iterator_category;
+      if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                      category>) {
+        insert_realloc(pos, n, in_parallel(construct));
+      } else {
+        insert_realloc(pos, n, construct);
+      }
+      return;
+    }
+    insert_in_place(pos, n, construct, [&](T* dst, size_t from, size_t count) {
+      std::copy_n(std::next(first, from), count, dst);
+    });
   }
 
   template <typename S>
@@ -98,9 +384,62 @@ struct basic_vector {
 
   void pop_back() noexcept {
     assert(size());
-    (begin() + (--size()))->~T();
+    destroy_n(begin_write() + (--size()), 1);
   }
 
+  //  a shared block is replaced with a copy of the kept elements
+  void erase(size_t pos, size_t n) {
+    assert(pos + n <= size());
+    if (!unique()) {
+      copy_without(pos, n);
+      return;
+    }
+    T* p = begin_write() + pos;
+    T* e = begin_write() + size();
+    if constexpr (is_trivially_relocatable_v<T>) {
+      destroy_n(p, n);
+      std::memmove(static_cast<void*>(p), p + n, (e - p - n) * sizeof(T));
+    } else {
+      std::move(p + n, e, p);
+      destroy_n(e - n, n);
+    }
+    size() -= n;
+  }
+
+  //  a shared block is replaced with a copy of the kept elements,
+  //  returns the number of erased ones
+  template <typename Predicate>
+  size_t erase_if(Predicate pred) {
+    size_t old_size = size();
+    if (unique()) {
+      T* e = begin_write() + old_size;
+      T* new_end = std::remove_if(begin_write(), e, pred);
+      destroy_n(new_end, e - new_end);
+      size() = new_end - begin_write();
+      return old_size - size();
+    }
+    char* new_data = allocate(capacity());
+    T* dst = begin(new_data);
+    try {
+      for (const_iterator src = begin(data_), e = src + old_size;
+           src != e; ++src) {
+        if (!pred(*src)) {
+          new(dst) T(*src);
+          ++dst;
+        }
+      }
+    } catch (...) {
+      destroy_n(begin(new_data), dst - begin(new_data));
+      deallocate(new_data);
+      throw;
+    }
+    size(new_data) = dst - begin(new_data);
+    destroy_self();
+    data_ = new_data;
+    return old_size - size();
+  }
+
+  //  copies a shared block only if it has to grow
   void reserve(size_t n) {
     if (n > capacity()) {
       set_capacity(n);
@@ -112,13 +451,13 @@ struct basic_vector {
   }
 
   void detach() {
-    if (ref_count() != 1) {
+    if (!unique()) {
       set_capacity(capacity());
     }
   }
 
   void clear() noexcept {
-    std::destroy_n(begin(), size());
+    destroy_n(begin_write(), size());
     size() = 0;
   }
 
@@ -128,91 +467,397 @@ struct basic_vector {
 
  private:
 
-  static constexpr size_t const ALIGN_T = alignof(T);
-  static constexpr size_t const EXTRA = 3 * sizeof(size_t);
+  static_assert((DataAlign & (DataAlign - 1)) == 0);
+
+  static constexpr size_t const ALIGN_T = std::max(alignof(T), DataAlign);
+
+  //  blocks are allocated in units aligned for both the header and T
+  static constexpr size_t const ALIGN_BLOCK =
+          std::max(ALIGN_T, alignof(std::max_align_t));
+
+  struct alignas(ALIGN_BLOCK) unit_t {
+    unsigned char bytes[ALIGN_BLOCK];
+  };
+
+  using alloc_t = typename std::allocator_traits<Allocator>::
+  template rebind_alloc<unit_t>;
+  using alloc_traits = std::allocator_traits<alloc_t>;
+
+  struct header_t {
+    size_t capacity;
+    size_t size;
+    typename RefCount::counter ref_count;
+    //  0 if not computed yet, EXPOSED if not to be cached,
+    //  atomic as const copies share it
+    mutable std::atomic<size_t> hash;
+    [[no_unique_address]] alloc_t alloc;
+
+    header_t(size_t cap, alloc_t const& a) noexcept
+            : capacity(cap), size(0), hash(0), alloc(a) {
+      RefCount::init(ref_count);
+    }
+  };
+
+  static_assert(alignof(header_t) <= ALIGN_BLOCK);
+
+  //  no hash_range result, see header_t::hash
+  static constexpr size_t const EXPOSED = size_t(-1);
+  //  set in the capacity of a block mapped by mapped_file, whose owners
+  //  count two each, so it is never unique and is unmapped, not freed
+  static constexpr size_t const MAPPED = ~(size_t(-1) >> 1);
+  static constexpr size_t const EXTRA = sizeof(header_t);
   static constexpr size_t const GAP = (ALIGN_T - EXTRA % ALIGN_T) % ALIGN_T;
   static constexpr size_t const DATA_SHIFT = EXTRA + GAP;
+  static constexpr bool const NOTHROW_RELOCATE =
+          is_trivially_relocatable_v<T> ||
+          !std::__move_if_noexcept_cond<T>::value;
+  //  a unique block grows by reallocation, the allocator moves the bytes
+  static constexpr bool const REALLOCATE =
+          has_reallocate<alloc_t>::value && is_trivially_relocatable_v<T>;
   static constexpr size_t const INITIAL_CAPACITY = std::max<size_t>(4,
                                                                     _INITIAL_CAPACITY);
+  //  set by mapped_file before it maps a block
+  static inline std::atomic<void (*)(void*, size_t) noexcept> unmap_{nullptr};
+
   char* data_;
 
-  char* allocate(size_t cap) {
-    char* result = static_cast<char*>(operator new(
-            DATA_SHIFT + cap * sizeof(T)));
-    capacity(result) = cap;
+  friend struct mapped_file<basic_vector>;
+
+  explicit basic_vector(char* data) noexcept : data_(data) {
+  }
+
+  static size_t units(size_t cap) noexcept {
+    return (DATA_SHIFT + cap * sizeof(T) + ALIGN_BLOCK - 1) / ALIGN_BLOCK;
+  }
+
+  static char* allocate(size_t cap, alloc_t alloc) {
+    char* result = reinterpret_cast<char*>(
+            alloc_traits::allocate(alloc, units(cap)));
+    new(result) header_t(cap, alloc);
     return result;
   }
 
-  char* make_copy(size_t cap) {
-    char* new_data = allocate(cap);
-    size(new_data) = size();
-    ref_count(new_data) = 1;
-    for (auto src = begin(), end = src + size(), dst = begin(new_data);
-         src != end; ++src, ++dst) {
+  //  a block with the same allocator as ours
+  char* allocate(size_t cap) const {
+    return allocate(cap, header(data_)->alloc);
+  }
+
+  static void deallocate(char* p) noexcept {
+    header_t* h = header(p);
+    if (mapped(p)) {
+      unmap_.load(std::memory_order_relaxed)(p, block_bytes(p));
+      return;
+    }
+    alloc_t alloc(std::move(h->alloc));
+    size_t n = units(h->capacity);
+    h->~header_t();
+    alloc_traits::deallocate(alloc, reinterpret_cast<unit_t*>(p), n);
+  }
+
+  //  moves our elements to new_data leaving n constructed elements
+  //  at pos alone and releases the old block,
+  //  elements are copied instead while the block is shared
+  void transfer(char* new_data, size_t pos, size_t n) {
+    T* src = begin(data_);
+    T* dst = begin(new_data);
+    size_t sz = size();
+    if (unique() && NOTHROW_RELOCATE) {
+      relocate_n(src, pos, dst);
+      relocate_n(src + pos, sz - pos, dst + pos + n);
+      size(new_data) = sz + n;
+      deallocate(data_);
+    } else {
+      copy_n(src, pos, dst);
       try {
-        new(dst) T(std::move_if_noexcept(*src));
+        copy_n(src + pos, sz - pos, dst + pos + n);
       } catch (...) {
-        destroy_n(new_data, dst - begin(new_data));
+        destroy_n(dst, pos);
         throw;
       }
+      size(new_data) = sz + n;
+      destroy_self();
     }
-    return new_data;
+    data_ = new_data;
   }
 
   void set_capacity(size_t cap) {
-    char* new_data = make_copy(cap);
+    if constexpr (REALLOCATE) {
+      if (unique()) {
+        reallocate(cap);
+        return;
+      }
+    }
+    char* new_data = allocate(cap);
+    try {
+      transfer(new_data, size(), 0);
+    } catch (...) {
+      deallocate(new_data);
+      throw;
+    }
+  }
+
+  void copy_without(size_t pos, size_t n) {
+    char* new_data = allocate(capacity());
+    const_iterator src = begin(data_);
+    T* dst = begin(new_data);
+    try {
+      copy_n(src, pos, dst);
+      try {
+        copy_n(src + pos + n, size() - pos - n, dst + pos);
+      } catch (...) {
+        destroy_n(dst, pos);
+        throw;
+      }
+    } catch (...) {
+      deallocate(new_data);
+      throw;
+    }
+    size(new_data) = size() - n;
     destroy_self();
     data_ = new_data;
   }
 
-  void destroy(char* p) noexcept {
-    destroy_n(p, size(p));
+  //  construct(dst, from, count) builds new elements [from, from + count)
+  //  in raw memory at dst, either all of them or none
+
+  template <typename Construct>
+  void insert_realloc(size_t pos, size_t n, Construct construct) {
+    size_t cap = grown_capacity(n);
+    if constexpr (REALLOCATE) {
+      if (unique() && pos == size()) {
+        append_reallocating(n, cap, construct);
+        return;
+      }
+    }
+    //  construct the new elements first, they may refer to our elements
+    char* new_data = allocate(cap);
+    try {
+      construct(begin(new_data) + pos, 0, n);
+    } catch (...) {
+      deallocate(new_data);
+      throw;
+    }
+    try {
+      transfer(new_data, pos, n);
+    } catch (...) {
+      destroy_n(begin(new_data) + pos, n);
+      deallocate(new_data);
+      throw;
+    }
+  }
+
+  size_t grown_capacity(size_t n) const noexcept {
+    size_t cap = capacity();
+    if (size() + n > cap) {
+      cap = Growth::grow(cap, std::max(INITIAL_CAPACITY, size() + n),
+                         DATA_SHIFT, sizeof(T));
+    }
+    return cap;
+  }
+
+  //  a unique block of trivially relocatable elements, the bytes are
+  //  kept by the allocator which may move them
+  void reallocate(size_t cap) {
+    alloc_t alloc(header(data_)->alloc);
+    data_ = reinterpret_cast<char*>(alloc.reallocate(
+            reinterpret_cast<unit_t*>(data_), units(capacity()), units(cap)));
+    header(data_)->capacity = cap;
+  }
+
+  //  the new elements may refer to ours, so they are built aside first
+  template <typename Construct>
+  void append_reallocating(size_t n, size_t cap, Construct construct) {
+    std::allocator<T> aside_alloc;
+    T* aside = aside_alloc.allocate(n);
+    try {
+      construct(aside, 0, n);
+    } catch (...) {
+      aside_alloc.deallocate(aside, n);
+      throw;
+    }
+    try {
+      reallocate(cap);
+    } catch (...) {
+      destroy_n(aside, n);
+      aside_alloc.deallocate(aside, n);
+      throw;
+    }
+    relocate_n(aside, n, begin_write() + size());
+    aside_alloc.deallocate(aside, n);
+    size() += n;
+  }
+
+  //  MayAlias is false if construct never reads our elements,
+  //  such elements are built in place after reallocation
+  template <bool MayAlias = true, typename Construct>
+  void append_n(size_t n, Construct construct) {
+    if constexpr (REALLOCATE && !MayAlias) {
+      if (unique() && size() + n > capacity()) {
+        reallocate(grown_capacity(n));
+      }
+    }
+    if (!unique() || size() + n > capacity()) {
+      insert_realloc(size(), n, construct);
+      return;
+    }
+    construct(begin_write() + size(), 0, n);
+    size() += n;
+  }
+
+  //  assign(dst, from, count) is the same for live elements,
+  //  the tail is shifted once, the old elements stay valid on failure
+  template <typename Construct, typename Assign>
+  void insert_in_place(size_t pos, size_t n, Construct construct,
+                       Assign assign) {
+    assert(unique() && size() + n <= capacity());
+    T* p = begin_write() + pos;
+    T* e = begin_write() + size();
+    size_t after = size() - pos;
+    if constexpr (is_trivially_relocatable_v<T>) {
+      std::memmove(static_cast<void*>(p + n), p, after * sizeof(T));
+      try {
+        construct(p, 0, n);
+      } catch (...) {
+        std::memmove(static_cast<void*>(p), p + n, after * sizeof(T));
+        throw;
+      }
+      size() += n;
+    } else if (after > n) {
+      std::uninitialized_move(e - n, e, e);
+      size() += n;
+      std::move_backward(p, e - n, e);
+      assign(p, 0, n);
+    } else {
+      construct(e, after, n - after);
+      size() += n - after;
+      try {
+        std::uninitialized_move(p, e, p + n);
+      } catch (...) {
+        destroy_n(e, n - after);
+        size() -= n - after;
+        throw;
+      }
+      size() += after;
+      assign(p, 0, after);
+    }
+  }
+
+  //  either constructs all n elements or none
+  static void copy_n(T const* src, size_t n, T* dst) {
+    in_parallel([src](T* to, size_t from, size_t count) {
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(static_cast<void*>(to), src + from, count * sizeof(T));
+      } else {
+        std::uninitialized_copy_n(src + from, count, to);
+      }
+    })(dst, 0, n);
+  }
+
+  //  the same construct, ranges of parallel_threshold bytes or more
+  //  are split between threads if T allows
+  template <typename Construct>
+  static auto in_parallel(Construct construct) {
+    return [construct](T* dst, size_t from, size_t count) {
+      if constexpr (is_parallel_constructible_v<T>) {
+        if (count * sizeof(T) >= parallel_threshold) {
+          parallel_construct(count, count * sizeof(T),
+                             [&](size_t first, size_t n) {
+                               construct(dst + first, from + first, n);
+                             }, [&](size_t first, size_t n) {
+                               destroy_n(dst + first, n);
+                             });
+          return;
+        }
+      }
+      construct(dst, from, count);
+    };
   }
 
-  void destroy_n(char* p, size_t n) noexcept {
-    std::destroy_n(begin(p), n);
-    operator delete(p);
+  //  src is left as raw memory
+  static void relocate_n(T* src, size_t n, T* dst) {
+    if constexpr (is_trivially_relocatable_v<T>) {
+      std::memcpy(static_cast<void*>(dst), src, n * sizeof(T));
+    } else {
+      std::uninitialized_move_n(src, n, dst);
+      std::destroy_n(src, n);
+    }
+  }
+
+  static void destroy_n(T* p, size_t n) noexcept {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      std::destroy_n(p, n);
+    }
+  }
+
+  void destroy(char* p) noexcept {
+    destroy_n(begin(p), size(p));
+    deallocate(p);
   }
 
   void destroy_self() noexcept {
-    if (!(--ref_count())) {
+    if (mapped(data_)) {
+      RefCount::release(header(data_)->ref_count);
+    }
+    if (RefCount::release(header(data_)->ref_count)) {
+      if constexpr (has_deferred_release<RefCount>::value) {
+        if (RefCount::defer(&reclaim, data_, block_bytes(data_))) {
+          return;
+        }
+      }
       destroy(data_);
     }
   }
 
-  //  copying was performed
-  void revert(char* new_data, std::true_type) {
-    destroy(new_data);
+  static void reclaim(char* p) noexcept {
+    destroy_n(reinterpret_cast<T*>(p + DATA_SHIFT), header(p)->size);
+    deallocate(p);
   }
 
-  //  move was performed
-  void revert(char* new_data, std::false_type) {
-    std::move(begin(new_data), begin(new_data) + size(), begin());
+  static size_t block_bytes(char const* p) noexcept {
+    size_t cap = header(p)->capacity;
+    if (cap & MAPPED) {
+      return DATA_SHIFT + (cap & ~MAPPED) * sizeof(T);
+    }
+    return units(cap) * sizeof(unit_t);
   }
 
-  size_t& capacity(char* p) noexcept {
-    return *reinterpret_cast<size_t*>(p);
+  static bool mapped(char const* p) noexcept {
+    return header(p)->capacity & MAPPED;
   }
 
-  size_t& capacity() noexcept {
-    return capacity(data_);
+  //  for changes made here, the cached hash is dropped
+  iterator begin_write() noexcept {
+    auto& cached = header(data_)->hash;
+    size_t h = cached.load(std::memory_order_relaxed);
+    if (h != 0 && h != EXPOSED) {
+      cached.store(0, std::memory_order_relaxed);
+    }
+    return begin(data_);
   }
 
-  size_t& size(char* p) noexcept {
-    return *(reinterpret_cast<size_t*>(p) + 1);
+  static header_t* header(char* p) noexcept {
+    return reinterpret_cast<header_t*>(p);
   }
 
-  size_t& size() noexcept {
-    return size(data_);
+  static header_t const* header(char const* p) noexcept {
+    return reinterpret_cast<header_t const*>(p);
   }
 
-  size_t& ref_count(char* p) noexcept {
-    return *(reinterpret_cast<size_t*>(p) + 2);
+  size_t& size(char* p) noexcept {
+    return header(p)->size;
   }
 
-  size_t& ref_count() noexcept {
-    return ref_count(data_);
+  size_t& size() noexcept {
+    return size(data_);
   }
 };
 
+//  a buffer is a single pointer to its block
+template <typename T, size_t INITIAL_CAPACITY, typename RefCount,
+        typename Allocator, typename Growth, size_t DataAlign>
+struct is_trivially_relocatable<basic_vector<T, INITIAL_CAPACITY, RefCount,
+                                             Allocator, Growth, DataAlign>>
+        : std::true_type {
+};
+
 #endif //BASIC_VECTOR_H
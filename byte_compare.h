@@ -0,0 +1,145 @@
+#ifndef BYTE_COMPARE_H
+#define BYTE_COMPARE_H
+
+//  comparison and hashing of element ranges by their bytes
+//  on x86-64 the mismatch search uses SSE2, or AVX2 if the CPU has it
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <functional>
+#include <string_view>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BYTE_COMPARE_X86
+#endif
+
+//  equal objects of such types have equal bytes and vice versa,
+//  specialize for padding-free types compared member by member
+template <typename T>
+struct is_bitwise_comparable
+        : std::bool_constant<std::is_integral_v<T> || std::is_pointer_v<T>> {
+};
+
+template <typename T>
+constexpr bool is_bitwise_comparable_v = is_bitwise_comparable<T>::value;
+
+//  index of the first differing byte of two n-byte ranges, n if none
+inline size_t first_mismatch_scalar(unsigned char const* a,
+                                    unsigned char const* b,
+                                    size_t n) noexcept {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+    uint64_t x, y;
+    std::memcpy(&x, a + i, sizeof(x));
+    std::memcpy(&y, b + i, sizeof(y));
+    if (x != y) {
+      break;
+    }
+  }
+  for (; i != n && a[i] == b[i]; ++i) {
+  }
+  return i;
+}
+
+#ifdef BYTE_COMPARE_X86
+
+inline size_t first_mismatch_sse2(unsigned char const* a,
+                                  unsigned char const* b,
+                                  size_t n) noexcept {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+    unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+    if (mask != 0xFFFF) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  return i + first_mismatch_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline size_t first_mismatch_avx2(unsigned char const* a,
+                                  unsigned char const* b,
+                                  size_t n) noexcept {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+    unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+    if (mask != 0xFFFFFFFFu) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  return i + first_mismatch_sse2(a + i, b + i, n - i);
+}
+
+#endif
+
+inline size_t first_mismatch(void const* a, void const* b, size_t n) noexcept {
+  auto x = static_cast<unsigned char const*>(a);
+  auto y = static_cast<unsigned char const*>(b);
+#ifdef BYTE_COMPARE_X86
+  using kernel_t = size_t (*)(unsigned char const*, unsigned char const*,
+                              size_t) noexcept;
+  static kernel_t const kernel = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? kernel_t(first_mismatch_avx2)
+                                          : kernel_t(first_mismatch_sse2);
+  }();
+  return kernel(x, y, n);
+#else
+  return first_mismatch_scalar(x, y, n);
+#endif
+}
+
+//  for bitwise comparable T the same buffer compares equal without
+//  reading it, other T may have an operator== that is not reflexive,
+//  as double with NaN, and are compared element by element
+
+template <typename T>
+bool range_equal(T const* a, T const* b, size_t n) {
+  if constexpr (is_bitwise_comparable_v<T>) {
+    return a == b || n == 0 || std::memcmp(a, b, n * sizeof(T)) == 0;
+  } else {
+    return std::equal(a, a + n, b);
+  }
+}
+
+template <typename T>
+bool range_less(T const* a, size_t n, T const* b, size_t m) {
+  if constexpr (is_bitwise_comparable_v<T>) {
+    if (a == b) {
+      return n < m;
+    }
+    size_t common = std::min(n, m);
+    size_t i = common ? first_mismatch(a, b, common * sizeof(T)) / sizeof(T)
+                      : 0;
+    return i == common ? n < m : a[i] < b[i];
+  } else {
+    return std::lexicographical_compare(a, a + n, b, b + m);
+  }
+}
+
+//  never 0 or size_t(-1), so that these may mark a hash not cached
+template <typename T>
+size_t hash_range(T const* a, size_t n) {
+  size_t result;
+  if constexpr (is_bitwise_comparable_v<T>) {
+    result = std::hash<std::string_view>()(std::string_view(
+            reinterpret_cast<char const*>(a), n * sizeof(T)));
+  } else {
+    result = n;
+    for (size_t i = 0; i != n; ++i) {
+      result ^= std::hash<T>()(a[i]) + 0x9e3779b97f4a7c15 +
+                (result << 6) + (result >> 2);
+    }
+  }
+  return result && ~result ? result : 1;
+}
+
+#endif //BYTE_COMPARE_H
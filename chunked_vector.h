@@ -0,0 +1,302 @@
+#ifndef CHUNKED_VECTOR_H
+#define CHUNKED_VECTOR_H
+
+//  copy-on-write per chunk of ChunkSize elements
+//  copies share a spine of chunk handles, a write copies the spine
+//  (handles only) and the touched chunk, the rest stays shared
+//  all chunks but the last are full
+//  elements are contiguous within a chunk, see chunk and mutable_chunk
+
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "basic_vector.h"
+#include "byte_compare.h"
+#include "vector.h"
+
+template <typename T,
+        size_t ChunkSize = std::max<size_t>(1, (size_t(1) << 16) / sizeof(T)),
+        typename RefCount = plain_ref_count,
+        typename Allocator = std::allocator<T>>
+struct chunked_vector {
+  static_assert(ChunkSize > 0);
+
+  using value_type = T;
+  using allocator_type = Allocator;
+
+  struct const_iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = T const*;
+    using reference = T const&;
+
+    const_iterator() = default;
+
+    reference operator*() const noexcept {
+      return (*v_)[i_];
+    }
+
+    pointer operator->() const noexcept {
+      return &**this;
+    }
+
+    reference operator[](difference_type n) const noexcept {
+      return (*v_)[i_ + n];
+    }
+
+    const_iterator& operator++() noexcept {
+      ++i_;
+      return *this;
+    }
+
+    const_iterator operator++(int) noexcept {
+      const_iterator result = *this;
+      ++i_;
+      return result;
+    }
+
+    const_iterator& operator--() noexcept {
+      --i_;
+      return *this;
+    }
+
+    const_iterator operator--(int) noexcept {
+      const_iterator result = *this;
+      --i_;
+      return result;
+    }
+
+    const_iterator& operator+=(difference_type n) noexcept {
+      i_ += n;
+      return *this;
+    }
+
+    const_iterator& operator-=(difference_type n) noexcept {
+      i_ -= n;
+      return *this;
+    }
+
+    friend const_iterator operator+(const_iterator it,
+                                    difference_type n) noexcept {
+      return it += n;
+    }
+
+    friend const_iterator operator+(difference_type n,
+                                    const_iterator it) noexcept {
+      return it += n;
+    }
+
+    friend const_iterator operator-(const_iterator it,
+                                    difference_type n) noexcept {
+      return it -= n;
+    }
+
+    friend difference_type operator-(const_iterator const& lhs,
+                                     const_iterator const& rhs) noexcept {
+      return difference_type(lhs.i_) - difference_type(rhs.i_);
+    }
+
+    friend bool operator==(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return lhs.i_ == rhs.i_;
+    }
+
+    friend bool operator!=(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return lhs.i_ != rhs.i_;
+    }
+
+    friend bool operator<(const_iterator const& lhs,
+                          const_iterator const& rhs) noexcept {
+      return lhs.i_ < rhs.i_;
+    }
+
+    friend bool operator>(const_iterator const& lhs,
+                          const_iterator const& rhs) noexcept {
+      return rhs < lhs;
+    }
+
+    friend bool operator<=(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return !(rhs < lhs);
+    }
+
+    friend bool operator>=(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return !(lhs < rhs);
+    }
+
+   private:
+    friend struct chunked_vector;
+
+    const_iterator(chunked_vector const* v, size_t i) noexcept
+            : v_(v), i_(i) {
+    }
+
+    chunked_vector const* v_ = nullptr;
+    size_t i_ = 0;
+  };
+
+  explicit chunked_vector(Allocator const& alloc = Allocator())
+          : spine_(spine_alloc_t(alloc)) {
+  }
+
+  chunked_vector(size_t n, T const& val,
+                 Allocator const& alloc = Allocator())
+          : chunked_vector(alloc) {
+    spine_.reserve((n + ChunkSize - 1) / ChunkSize);
+    while (n) {
+      size_t count = std::min(n, ChunkSize);
+      chunk_t chunk = chunk_t::with_capacity(ChunkSize, alloc);
+      chunk.append(count, val);
+      spine_.push_back(chunk);
+      n -= count;
+    }
+  }
+
+  size_t size() const noexcept {
+    size_t chunks = chunk_count();
+    return chunks ? (chunks - 1) * ChunkSize + last_chunk().size() : 0;
+  }
+
+  bool empty() const noexcept {
+    return chunk_count() == 0;
+  }
+
+  Allocator get_allocator() const noexcept {
+    return Allocator(spine_.get_allocator());
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    assert(at < size());
+    return spine_.begin()[at / ChunkSize].begin()[at % ChunkSize];
+  }
+
+  //  copies the chunk holding the element if it is shared
+  T& operator[](size_t at) {
+    assert(at < size());
+    return mutable_chunk(at / ChunkSize)[at % ChunkSize];
+  }
+
+  T const& front() const noexcept {
+    return (*this)[0];
+  }
+
+  T& front() {
+    return (*this)[0];
+  }
+
+  T const& back() const noexcept {
+    return (*this)[size() - 1];
+  }
+
+  T& back() {
+    return (*this)[size() - 1];
+  }
+
+  const_iterator begin() const noexcept {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const noexcept {
+    return const_iterator(this, size());
+  }
+
+  size_t chunk_count() const noexcept {
+    return spine_.size();
+  }
+
+  vector_span<T const> chunk(size_t k) const noexcept {
+    assert(k < chunk_count());
+    chunk_t const& c = spine_.begin()[k];
+    return {c.begin(), c.size()};
+  }
+
+  //  unshares the spine and chunk k only
+  vector_span<T> mutable_chunk(size_t k) {
+    assert(k < chunk_count());
+    chunk_t& c = unshared_chunk(k);
+    return {c.begin(), std::as_const(c).size()};
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&& ... args) {
+    if (empty() || last_chunk().size() == ChunkSize) {
+      chunk_t chunk = chunk_t::with_capacity(ChunkSize, get_allocator());
+      chunk.emplace_back(std::forward<Args>(args)...);
+      spine_.push_back(chunk);
+      return;
+    }
+    unshared_chunk(chunk_count() - 1).emplace_back(
+            std::forward<Args>(args)...);
+  }
+
+  void push_back(T const& val) {
+    emplace_back(val);
+  }
+
+  void pop_back() {
+    assert(!empty());
+    if (last_chunk().size() == 1) {
+      spine_.detach();
+      spine_.pop_back();
+      return;
+    }
+    unshared_chunk(chunk_count() - 1).pop_back();
+  }
+
+  //  a shared spine is left to its other owners
+  void clear() {
+    if (!spine_.unique()) {
+      spine_t empty(spine_.get_allocator());
+      spine_.swap(empty);
+      return;
+    }
+    spine_.clear();
+  }
+
+  friend bool operator==(chunked_vector const& lhs,
+                         chunked_vector const& rhs) {
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    for (size_t k = 0; k != lhs.chunk_count(); ++k) {
+      auto a = lhs.chunk(k);
+      auto b = rhs.chunk(k);
+      if (!range_equal(a.data(), b.data(), a.size())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(chunked_vector const& lhs,
+                         chunked_vector const& rhs) {
+    return !(lhs == rhs);
+  }
+
+ private:
+
+  using chunk_t = basic_vector<T, ChunkSize, RefCount, Allocator>;
+  using spine_alloc_t = typename std::allocator_traits<Allocator>::
+  template rebind_alloc<chunk_t>;
+  using spine_t = basic_vector<chunk_t, 4, RefCount, spine_alloc_t>;
+
+  spine_t spine_;
+
+  chunk_t const& last_chunk() const noexcept {
+    return spine_.begin()[chunk_count() - 1];
+  }
+
+  chunk_t& unshared_chunk(size_t k) {
+    spine_.detach();
+    chunk_t& c = spine_.begin()[k];
+    c.detach();
+    return c;
+  }
+};
+
+#endif //CHUNKED_VECTOR_H
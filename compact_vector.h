@@ -0,0 +1,391 @@
+#ifndef COMPACT_VECTOR_H
+#define COMPACT_VECTOR_H
+
+//  vector of trivially copyable T in a single word
+//  sizeof(compact_vector<T>) == sizeof(void*)
+//  the word is empty (all zero), holds one element in place (tag bit set)
+//  or a pointer to a shared buffer (blocks are aligned, tag bit clear)
+//  T with alignof(T) + sizeof(T) > sizeof(void*) has no in-place state,
+//  a single element lives in a buffer then
+//  copy-on-write
+//  stateless allocators only, there is no room to keep one
+
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include <cassert>
+#include <algorithm>
+#include <new>
+
+#include "basic_vector.h"
+
+template <typename T, typename RefCount = plain_ref_count,
+        typename Allocator = std::allocator<T>,
+        typename Growth = doubling_growth>
+struct compact_vector {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static_assert(std::is_empty_v<Allocator>);
+
+  using value_type = T;
+
+  using iterator = T*;
+  using const_iterator = T const*;
+
+  compact_vector() noexcept {
+    set_nothing();
+  }
+
+  compact_vector(compact_vector const& other) noexcept {
+    if (other.holds_buffer()) {
+      new(word_) buffer_t(other.as_buffer());
+    } else {
+      std::memcpy(word_, other.word_, sizeof(word_));
+    }
+  }
+
+  //  a buffer is a plain pointer, so moving the word moves it
+  compact_vector(compact_vector&& other) noexcept {
+    std::memcpy(word_, other.word_, sizeof(word_));
+    other.set_nothing();
+  }
+
+  compact_vector(std::initializer_list<T> init) : compact_vector() {
+    reserve(init.size());
+    for (T const& x : init) {
+      push_back(x);
+    }
+  }
+
+  compact_vector& operator=(compact_vector const& other) noexcept {
+    compact_vector copy_(other);
+    swap(copy_);
+    return *this;
+  }
+
+  compact_vector& operator=(compact_vector&& other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~compact_vector() noexcept {
+    reset();
+  }
+
+  void swap(compact_vector& other) noexcept {
+    std::swap(word_, other.word_);
+  }
+
+  friend void swap(compact_vector& lhs, compact_vector& rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+  size_t size() const noexcept {
+    if (holds_value()) {
+      return 1;
+    }
+    return holds_nothing() ? 0 : as_buffer().size();
+  }
+
+  size_t capacity() const noexcept {
+    return holds_buffer() ? as_buffer().capacity() : HAS_VALUE;
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  iterator begin() {
+    if (holds_value()) {
+      return value_ptr();
+    }
+    if (holds_nothing()) {
+      return nullptr;
+    }
+    as_buffer().detach();
+    return as_buffer().begin();
+  }
+
+  const_iterator begin() const noexcept {
+    if (holds_value()) {
+      return value_ptr();
+    }
+    return holds_nothing() ? nullptr : as_buffer().begin();
+  }
+
+  const_iterator cbegin() const noexcept {
+    return begin();
+  }
+
+  iterator end() {
+    return begin() + size();
+  }
+
+  const_iterator end() const noexcept {
+    return begin() + size();
+  }
+
+  const_iterator cend() const noexcept {
+    return end();
+  }
+
+  T* data() {
+    return begin();
+  }
+
+  T const* data() const noexcept {
+    return begin();
+  }
+
+  T& operator[](size_t at) {
+    assert(at < size());
+    return *(begin() + at);
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    assert(at < size());
+    return *(begin() + at);
+  }
+
+  T& front() {
+    return (*this)[0];
+  }
+
+  T const& front() const noexcept {
+    return (*this)[0];
+  }
+
+  T& back() {
+    return (*this)[size() - 1];
+  }
+
+  T const& back() const noexcept {
+    return (*this)[size() - 1];
+  }
+
+  friend bool operator==(compact_vector const& lhs, compact_vector const& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+  friend bool operator!=(compact_vector const& lhs, compact_vector const& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(compact_vector const& lhs, compact_vector const& rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(),
+                                        rhs.begin(), rhs.end());
+  }
+
+  friend bool operator>(compact_vector const& lhs, compact_vector const& rhs) {
+    return rhs < lhs;
+  }
+
+  friend bool operator<=(compact_vector const& lhs, compact_vector const& rhs) {
+    return !(lhs > rhs);
+  }
+
+  friend bool operator>=(compact_vector const& lhs, compact_vector const& rhs) {
+    return !(lhs < rhs);
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&& ... args) {
+    if (holds_buffer()) {
+      as_buffer().emplace_back(std::forward<Args>(args)...);
+      return;
+    }
+    if constexpr (HAS_VALUE) {
+      if (holds_nothing()) {
+        set_value(T(std::forward<Args>(args)...));
+        return;
+      }
+    }
+    auto new_data = to_buffer(0);
+    new_data.emplace_back(std::forward<Args>(args)...);
+    set_buffer(new_data);
+  }
+
+  void push_back(T const& val) {
+    emplace_back(val);
+  }
+
+  void pop_back() {
+    assert(!empty());
+    truncate(size() - 1);
+  }
+
+  void clear() noexcept {
+    if (holds_buffer() && as_buffer().unique()) {
+      as_buffer().clear();
+      return;
+    }
+    reset();
+  }
+
+  void reserve(size_t n) {
+    if (n <= capacity()) {
+      return;
+    }
+    if (holds_buffer()) {
+      as_buffer().reserve(n);
+      return;
+    }
+    set_buffer(to_buffer(n));
+  }
+
+  void shrink_to_fit() {
+    if (holds_buffer() && capacity() != size()) {
+      as_buffer().shrink_to_fit();
+    }
+  }
+
+  void resize(size_t n) {
+    resize(n, T());
+  }
+
+  //  val may be our element kept in the word, which set_buffer overwrites,
+  //  so it is copied first
+
+  void resize(size_t n, T const& val) {
+    if (n <= size()) {
+      truncate(n);
+      return;
+    }
+    if (n == 1) {
+      push_back(val);
+      return;
+    }
+    T tmp(val);
+    if (!holds_buffer()) {
+      set_buffer(to_buffer(n));
+    }
+    as_buffer().append(n - size(), tmp);
+  }
+
+  iterator insert(const_iterator pos, T const& val) {
+    size_t pos_i = pos - cbegin();
+    if (pos_i == size()) {
+      push_back(val);
+    } else {
+      T tmp(val);
+      if (!holds_buffer()) {
+        set_buffer(to_buffer(0));
+      }
+      as_buffer().emplace(pos_i, tmp);
+    }
+    return begin() + pos_i;
+  }
+
+  iterator erase(const_iterator pos) {
+    return erase(pos, pos + 1);
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    size_t first_i = first - cbegin();
+    size_t n = last - first;
+    if (n == size()) {
+      clear();
+    } else if (n) {
+      as_buffer().erase(first_i, n);
+    }
+    return begin() + first_i;
+  }
+
+ private:
+
+  using buffer_t = basic_vector<T, 4, RefCount, Allocator, Growth>;
+
+  static_assert(sizeof(buffer_t) == sizeof(void*));
+
+  //  the byte with the low bits of a pointer keeps the tag
+  static constexpr bool const LITTLE_ENDIAN_WORD =
+          __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+  static constexpr size_t const TAG_BYTE =
+          LITTLE_ENDIAN_WORD ? 0 : sizeof(void*) - 1;
+  static constexpr unsigned char const VALUE_TAG = 1;
+  static constexpr size_t const VALUE_OFFSET =
+          LITTLE_ENDIAN_WORD ? alignof(T) : 0;
+  static constexpr bool const HAS_VALUE =
+          alignof(T) <= alignof(void*) &&
+          (LITTLE_ENDIAN_WORD ? VALUE_OFFSET + sizeof(T) <= sizeof(void*)
+                              : sizeof(T) < sizeof(void*));
+
+  alignas(void*) unsigned char word_[sizeof(void*)];
+
+  bool holds_value() const noexcept {
+    return HAS_VALUE && (word_[TAG_BYTE] & VALUE_TAG);
+  }
+
+  bool holds_nothing() const noexcept {
+    uintptr_t bits;
+    std::memcpy(&bits, word_, sizeof(bits));
+    return !bits;
+  }
+
+  bool holds_buffer() const noexcept {
+    return !holds_value() && !holds_nothing();
+  }
+
+  T* value_ptr() noexcept {
+    return std::launder(reinterpret_cast<T*>(word_ + VALUE_OFFSET));
+  }
+
+  T const* value_ptr() const noexcept {
+    return std::launder(reinterpret_cast<T const*>(word_ + VALUE_OFFSET));
+  }
+
+  buffer_t& as_buffer() noexcept {
+    return *std::launder(reinterpret_cast<buffer_t*>(word_));
+  }
+
+  buffer_t const& as_buffer() const noexcept {
+    return *std::launder(reinterpret_cast<buffer_t const*>(word_));
+  }
+
+  //  the set_ functions expect nothing to be alive in the word
+
+  void set_nothing() noexcept {
+    std::memset(word_, 0, sizeof(word_));
+  }
+
+  void set_value(T const& val) noexcept {
+    set_nothing();
+    word_[TAG_BYTE] = VALUE_TAG;
+    new(word_ + VALUE_OFFSET) T(val);
+  }
+
+  void set_buffer(buffer_t const& buffer) noexcept {
+    reset();
+    new(word_) buffer_t(buffer);
+  }
+
+  void reset() noexcept {
+    if (holds_buffer()) {
+      as_buffer().~buffer_t();
+    }
+    set_nothing();
+  }
+
+  //  a buffer of capacity cap holding a copy of an in-place state
+  buffer_t to_buffer(size_t cap) const {
+    auto result = buffer_t::with_capacity(cap);
+    if (holds_value()) {
+      result.push_back(*value_ptr());
+    }
+    return result;
+  }
+
+  //  a shared buffer is replaced with a copy of the first n elements only
+  void truncate(size_t n) {
+    assert(n <= size());
+    if (n == size()) {
+      return;
+    }
+    if (n == 0) {
+      clear();
+      return;
+    }
+    as_buffer().erase(n, size() - n);
+  }
+};
+
+#endif //COMPACT_VECTOR_H
@@ -0,0 +1,116 @@
+#ifndef HUGE_PAGE_ALLOCATOR_H
+#define HUGE_PAGE_ALLOCATOR_H
+
+//  blocks of Threshold bytes or more are backed by huge pages:
+//  MAP_HUGETLB if the system has reserved them, otherwise a mapping
+//  aligned to a huge page with madvise(MADV_HUGEPAGE), which is only
+//  a hint, so the memory may still be in small pages
+//  smaller blocks come from std::allocator
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+
+#include "vector.h"
+
+constexpr size_t const huge_page_size = size_t(2) << 20;
+
+template <typename T, size_t Threshold = huge_page_size>
+struct huge_page_allocator {
+  static_assert(alignof(T) <= huge_page_size);
+
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = huge_page_allocator<U, Threshold>;
+  };
+
+  huge_page_allocator() noexcept = default;
+
+  template <typename U>
+  huge_page_allocator(huge_page_allocator<U, Threshold> const&) noexcept {
+  }
+
+  T* allocate(size_t n) {
+    if (!huge(n)) {
+      return std::allocator<T>().allocate(n);
+    }
+    void* p = map(length(n));
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (!huge(n)) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    ::munmap(p, length(n));
+  }
+
+  friend bool operator==(huge_page_allocator const&,
+                         huge_page_allocator const&) noexcept {
+    return true;
+  }
+
+  friend bool operator!=(huge_page_allocator const&,
+                         huge_page_allocator const&) noexcept {
+    return false;
+  }
+
+ private:
+
+  static bool huge(size_t n) noexcept {
+    return n >= (Threshold + sizeof(T) - 1) / sizeof(T);
+  }
+
+  static size_t length(size_t n) {
+    if (n > (size_t(-1) - huge_page_size) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return (n * sizeof(T) + huge_page_size - 1) & ~(huge_page_size - 1);
+  }
+
+  static void* map(size_t len) noexcept {
+    int const prot = PROT_READ | PROT_WRITE;
+    int const flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    void* p = ::mmap(nullptr, len, prot, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      return p;
+    }
+#endif
+    //  over-map, then trim to a huge page boundary
+    size_t over = len + huge_page_size;
+    void* raw = ::mmap(nullptr, over, prot, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+      return nullptr;
+    }
+    auto first = reinterpret_cast<uintptr_t>(raw);
+    auto aligned = (first + huge_page_size - 1) & ~(huge_page_size - 1);
+    if (aligned != first) {
+      ::munmap(raw, aligned - first);
+    }
+    size_t tail = first + over - (aligned + len);
+    if (tail) {
+      ::munmap(reinterpret_cast<void*>(aligned + len), tail);
+    }
+    auto result = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    ::madvise(result, len, MADV_HUGEPAGE);
+#endif
+    return result;
+  }
+};
+
+//  opt-in huge page backing for large buffers
+template <typename T>
+using huge_page_vector = vector<T, 1, plain_ref_count,
+                                huge_page_allocator<T>>;
+
+#endif //HUGE_PAGE_ALLOCATOR_H
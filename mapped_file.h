@@ -0,0 +1,151 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+//  vectors of trivially copyable elements saved to a file and mapped back,
+//  the file holds a block, the header and then size elements,
+//  mapped privately and shared by copies until the first write
+//  copies it to memory from the allocator
+
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <string>
+#include <system_error>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vector.h"
+
+template <typename T, size_t INITIAL_CAPACITY, typename RefCount,
+        typename Allocator, typename Growth, size_t DataAlign>
+struct mapped_file<basic_vector<T, INITIAL_CAPACITY, RefCount, Allocator,
+                                Growth, DataAlign>> {
+  using buffer_t = basic_vector<T, INITIAL_CAPACITY, RefCount, Allocator,
+                                Growth, DataAlign>;
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  static buffer_t map(std::string const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    size_t length = st.st_size;
+    if (length < buffer_t::DATA_SHIFT ||
+        (length - buffer_t::DATA_SHIFT) % sizeof(T)) {
+      ::close(fd);
+      throw std::runtime_error(path + ": not a vector file");
+    }
+    //  writable, the header is rewritten in a private copy of its page
+    void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    char* data = static_cast<char*>(p);
+    size_t sizes[2];
+    std::memcpy(sizes, data, sizeof(sizes));
+    if (sizes[0] != sizes[1] ||
+        sizes[1] != (length - buffer_t::DATA_SHIFT) / sizeof(T)) {
+      ::munmap(p, length);
+      throw std::runtime_error(path + ": not a vector file");
+    }
+    buffer_t::unmap_.store(&unmap, std::memory_order_relaxed);
+    auto h = new(data) typename buffer_t::header_t(
+            sizes[1] | buffer_t::MAPPED, typename buffer_t::alloc_t());
+    h->size = sizes[1];
+    RefCount::retain(h->ref_count);
+    return buffer_t(data);
+  }
+
+  //  n elements as a block for map
+  static void save(std::string const& path, T const* first, size_t n) {
+    alignas(typename buffer_t::header_t) char head[buffer_t::DATA_SHIFT] = {};
+    auto h = new(head) typename buffer_t::header_t(
+            n, typename buffer_t::alloc_t());
+    h->size = n;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    bool written = write_all(fd, head, buffer_t::DATA_SHIFT) &&
+                   write_all(fd, first, n * sizeof(T));
+    int error = errno;
+    if (::close(fd) != 0 && written) {
+      written = false;
+      error = errno;
+    }
+    if (!written) {
+      throw std::system_error(error, std::generic_category(), path);
+    }
+  }
+
+  static void save(std::string const& path, buffer_t const& buffer) {
+    save(path, buffer.begin(), buffer.size());
+  }
+
+ private:
+
+  static void unmap(void* p, size_t length) noexcept {
+    ::munmap(p, length);
+  }
+
+  static bool write_all(int fd, void const* p, size_t n) noexcept {
+    auto bytes = static_cast<char const*>(p);
+    while (n) {
+      ssize_t written = ::write(fd, bytes, n);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written < 0) {
+        return false;
+      }
+      bytes += written;
+      n -= written;
+    }
+    return true;
+  }
+};
+
+template <typename T, size_t N, typename RefCount, typename Allocator,
+        typename Growth, size_t DataAlign>
+struct mapped_file<vector<T, N, RefCount, Allocator, Growth, DataAlign>> {
+  using vector_t = vector<T, N, RefCount, Allocator, Growth, DataAlign>;
+  using buffer_t = typename vector_t::buffer_t;
+
+  static vector_t map(std::string const& path) {
+    vector_t result;
+    result.data_ = mapped_file<buffer_t>::map(path);
+    return result;
+  }
+
+  static void save(std::string const& path, vector_t const& v) {
+    mapped_file<buffer_t>::save(path, v.cbegin(), v.size());
+  }
+};
+
+//  the elements are shared with the page cache until the first write
+template <typename Vector>
+Vector map_file(std::string const& path) {
+  return mapped_file<Vector>::map(path);
+}
+
+template <typename Vector>
+void save_file(std::string const& path, Vector const& v) {
+  mapped_file<Vector>::save(path, v);
+}
+
+#endif //MAPPED_FILE_H
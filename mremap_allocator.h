@@ -0,0 +1,109 @@
+#ifndef MREMAP_ALLOCATOR_H
+#define MREMAP_ALLOCATOR_H
+
+//  malloc-based allocator able to resize a block in place,
+//  blocks of MapThreshold bytes or more are anonymous mappings
+//  resized with mremap, the kernel moves pages instead of copying them
+//  basic_vector grows trivially relocatable elements with reallocate
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+
+template <typename T, size_t MapThreshold = (size_t(1) << 20)>
+struct mremap_allocator {
+  static_assert(alignof(T) <= alignof(std::max_align_t));
+
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = mremap_allocator<U, MapThreshold>;
+  };
+
+  mremap_allocator() noexcept = default;
+
+  template <typename U>
+  mremap_allocator(mremap_allocator<U, MapThreshold> const&) noexcept {
+  }
+
+  T* allocate(size_t n) {
+    void* p = mapped(n) ? map(bytes(n)) : std::malloc(bytes(n));
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (mapped(n)) {
+      ::munmap(p, page_round(bytes(n)));
+    } else {
+      std::free(p);
+    }
+  }
+
+  //  the first min(old_n, n) elements keep their bytes, p is invalidated
+  //  unless the result is p, p stays valid if this throws
+  T* reallocate(T* p, size_t old_n, size_t n) {
+    void* result;
+    if (mapped(old_n) && mapped(n)) {
+      result = ::mremap(p, page_round(bytes(old_n)), page_round(bytes(n)),
+                        MREMAP_MAYMOVE);
+      if (result == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+    } else if (!mapped(old_n) && !mapped(n)) {
+      result = std::realloc(p, bytes(n));
+      if (!result) {
+        throw std::bad_alloc();
+      }
+    } else {
+      T* fresh = allocate(n);
+      std::memcpy(static_cast<void*>(fresh), p, bytes(std::min(old_n, n)));
+      deallocate(p, old_n);
+      result = fresh;
+    }
+    return static_cast<T*>(result);
+  }
+
+  friend bool operator==(mremap_allocator const&,
+                         mremap_allocator const&) noexcept {
+    return true;
+  }
+
+  friend bool operator!=(mremap_allocator const&,
+                         mremap_allocator const&) noexcept {
+    return false;
+  }
+
+ private:
+
+  static size_t bytes(size_t n) {
+    if (n > size_t(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return n * sizeof(T);
+  }
+
+  static bool mapped(size_t n) noexcept {
+    return n >= (MapThreshold + sizeof(T) - 1) / sizeof(T);
+  }
+
+  static size_t page_round(size_t b) noexcept {
+    static size_t const page = size_t(::sysconf(_SC_PAGESIZE));
+    return (b + page - 1) / page * page;
+  }
+
+  static void* map(size_t b) noexcept {
+    void* p = ::mmap(nullptr, page_round(b), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+};
+
+#endif //MREMAP_ALLOCATOR_H
@@ -0,0 +1,82 @@
+#ifndef PARALLEL_CONSTRUCT_H
+#define PARALLEL_CONSTRUCT_H
+
+//  large element ranges are constructed by several threads, one chunk each,
+//  a failed chunk builds nothing and the built ones are destroyed,
+//  so the range is built either as a whole or not at all
+
+#include <cstddef>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//  distinct objects of such types may be constructed on several threads
+//  at once, specialize for types whose constructors share no state
+template <typename T>
+struct is_parallel_constructible : std::is_trivially_copyable<T> {
+};
+
+template <typename T>
+constexpr bool is_parallel_constructible_v =
+        is_parallel_constructible<T>::value;
+
+//  ranges of fewer bytes are built by the calling thread alone
+constexpr size_t const parallel_threshold = size_t(1) << 24;
+
+//  construct(from, count) builds elements [from, from + count), all or none,
+//  destroy(from, count) destroys them, a chunk takes at least a quarter
+//  of parallel_threshold bytes
+template <typename Construct, typename Destroy>
+void parallel_construct(size_t n, size_t bytes, Construct construct,
+                        Destroy destroy,
+                        size_t threads = std::thread::hardware_concurrency()) {
+  size_t chunks = std::min(threads, bytes / (parallel_threshold / 4));
+  if (chunks < 2) {
+    construct(0, n);
+    return;
+  }
+  std::vector<std::exception_ptr> errors(chunks);
+  auto run = [&](size_t i) noexcept {
+    size_t from = n * i / chunks;
+    try {
+      construct(from, n * (i + 1) / chunks - from);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  size_t started = 1;
+  try {
+    workers.reserve(chunks - 1);
+    for (; started != chunks; ++started) {
+      workers.emplace_back(run, started);
+    }
+  } catch (...) {
+    //  chunks without a thread are built here
+  }
+  for (size_t i = started; i != chunks; ++i) {
+    run(i);
+  }
+  run(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  auto failed = std::find_if(errors.begin(), errors.end(),
+                             [](std::exception_ptr const& e) {
+                               return bool(e);
+                             });
+  if (failed == errors.end()) {
+    return;
+  }
+  for (size_t i = 0; i != chunks; ++i) {
+    if (!errors[i]) {
+      size_t from = n * i / chunks;
+      destroy(from, n * (i + 1) / chunks - from);
+    }
+  }
+  std::rethrow_exception(*failed);
+}
+
+#endif //PARALLEL_CONSTRUCT_H
@@ -0,0 +1,768 @@
+#ifndef PERSISTENT_VECTOR_H
+#define PERSISTENT_VECTOR_H
+
+//  persistent vector, a relaxed radix balanced tree (RRB-tree)
+//  versions share every node off the edited paths
+//  push_back, set, pop_back, concat and slice copy O(log n) nodes
+//  nodes hold up to 2^Bits children or elements, inner nodes keep
+//  cumulative sizes, so a lookup guesses the child by radix and
+//  corrects it by the sizes in relaxed nodes
+//  concat repacks the nodes along the seam evenly, as B-trees split
+//  transient_vector edits the nodes it created in place, for batches
+//  exception-safe, strong guarantee
+
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <initializer_list>
+
+#include "basic_vector.h"
+
+template <typename T, typename RefCount, size_t Bits>
+struct rrb_tree {
+  static_assert(Bits > 0);
+
+  static constexpr size_t const B = size_t(1) << Bits;
+
+  rrb_tree() noexcept = default;
+
+  rrb_tree(rrb_tree const& other) noexcept
+          : root_(other.root_), height_(other.height_), size_(other.size_) {
+    if (root_) {
+      RefCount::retain(root_->ref_count);
+    }
+  }
+
+  rrb_tree& operator=(rrb_tree const& other) noexcept {
+    rrb_tree copy_(other);
+    swap(copy_);
+    return *this;
+  }
+
+  ~rrb_tree() noexcept {
+    if (root_) {
+      release(root_, height_);
+    }
+  }
+
+  void swap(rrb_tree& other) noexcept {
+    std::swap(root_, other.root_);
+    std::swap(height_, other.height_);
+    std::swap(size_, other.size_);
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    assert(at < size_);
+    node_t const* n = root_;
+    for (size_t h = height_; h; --h) {
+      auto in = static_cast<inner_t const*>(n);
+      size_t idx = in->find(at, h);
+      at -= in->before(idx);
+      n = in->children[idx];
+    }
+    return static_cast<leaf_t const*>(n)->values()[at];
+  }
+
+  //  an owner edits in place the nodes it created, 0 copies every path
+  static uint64_t new_owner() noexcept {
+    static std::atomic<uint64_t> next(1);
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void push_back(T const& val, uint64_t owner) {
+    if (!root_) {
+      root_ = new_path(0, val, owner);
+      height_ = 0;
+      size_ = 1;
+      return;
+    }
+    node_t* result = push(root_, height_, val, owner);
+    if (!result) {
+      inner_t* r = new inner_t(owner);
+      node_guard g{r, height_ + 1};
+      node_t* path = new_path(height_, val, owner);
+      g.dismiss();
+      r->push_child(root_, size_);
+      r->push_child(path, 1);
+      result = r;
+      ++height_;
+    } else if (result != root_) {
+      release(root_, height_);
+    }
+    root_ = result;
+    ++size_;
+  }
+
+  void set(size_t at, T const& val, uint64_t owner) {
+    assert(at < size_);
+    node_t* result = set_at(root_, height_, at, val, owner);
+    if (result != root_) {
+      release(root_, height_);
+      root_ = result;
+    }
+  }
+
+  //  keeps the first n elements
+  void truncate(size_t n) {
+    assert(n <= size_);
+    if (n == size_) {
+      return;
+    }
+    if (n == 0) {
+      rrb_tree().swap(*this);
+      return;
+    }
+    replace_root(take(root_, height_, n));
+    size_ = n;
+  }
+
+  //  drops the first n elements
+  void drop_front(size_t n) {
+    assert(n <= size_);
+    if (n == 0) {
+      return;
+    }
+    if (n == size_) {
+      rrb_tree().swap(*this);
+      return;
+    }
+    replace_root(drop(root_, height_, n));
+    size_ -= n;
+  }
+
+  static rrb_tree concat(rrb_tree const& lhs, rrb_tree const& rhs) {
+    if (!rhs.size_) {
+      return lhs;
+    }
+    if (!lhs.size_) {
+      return rhs;
+    }
+    node_t* out[3];
+    size_t count = merge(lhs.root_, lhs.height_, rhs.root_, rhs.height_, out);
+    size_t height = std::max(lhs.height_, rhs.height_);
+    rrb_tree result;
+    if (count == 1) {
+      result.root_ = out[0];
+    } else {
+      inner_t* r;
+      try {
+        r = new inner_t(0);
+      } catch (...) {
+        for (size_t i = 0; i != count; ++i) {
+          release(out[i], height);
+        }
+        throw;
+      }
+      for (size_t i = 0; i != count; ++i) {
+        r->push_child(out[i], node_size(out[i], height));
+      }
+      result.root_ = r;
+      ++height;
+    }
+    result.height_ = height;
+    result.size_ = lhs.size_ + rhs.size_;
+    return result;
+  }
+
+ private:
+
+  struct node_t {
+    typename RefCount::counter ref_count;
+    uint64_t owner;
+    size_t count;
+
+    explicit node_t(uint64_t o) noexcept : owner(o), count(0) {
+      RefCount::init(ref_count);
+    }
+  };
+
+  struct leaf_t : node_t {
+    using node_t::node_t;
+
+    T* values() noexcept {
+      return std::launder(reinterpret_cast<T*>(storage));
+    }
+
+    T const* values() const noexcept {
+      return std::launder(reinterpret_cast<T const*>(storage));
+    }
+
+    alignas(T) unsigned char storage[B * sizeof(T)];
+  };
+
+  struct inner_t : node_t {
+    using node_t::node_t;
+
+    //  children of a node at height h hold up to B^h elements,
+    //  so the radix guess is never past the right child
+    size_t find(size_t at, size_t h) const noexcept {
+      size_t idx = at >> (Bits * h);
+      while (sizes[idx] <= at) {
+        ++idx;
+      }
+      return idx;
+    }
+
+    size_t before(size_t idx) const noexcept {
+      return idx ? sizes[idx - 1] : 0;
+    }
+
+    void push_child(node_t* child, size_t child_size) noexcept {
+      assert(this->count < B);
+      sizes[this->count] = before(this->count) + child_size;
+      children[this->count++] = child;
+    }
+
+    node_t* children[B];
+    size_t sizes[B];
+  };
+
+  //  releases an owned node on unwinding
+  struct node_guard {
+    node_t* node;
+    size_t height;
+
+    ~node_guard() noexcept {
+      if (node) {
+        release(node, height);
+      }
+    }
+
+    void dismiss() noexcept {
+      node = nullptr;
+    }
+  };
+
+  node_t* root_ = nullptr;
+  size_t height_ = 0;
+  size_t size_ = 0;
+
+  static leaf_t* as_leaf(node_t* n) noexcept {
+    return static_cast<leaf_t*>(n);
+  }
+
+  static inner_t* as_inner(node_t* n) noexcept {
+    return static_cast<inner_t*>(n);
+  }
+
+  static void retain(node_t* n) noexcept {
+    RefCount::retain(n->ref_count);
+  }
+
+  static void release(node_t* n, size_t h) noexcept {
+    if (!RefCount::release(n->ref_count)) {
+      return;
+    }
+    if (h == 0) {
+      leaf_t* l = as_leaf(n);
+      std::destroy_n(l->values(), l->count);
+      delete l;
+      return;
+    }
+    inner_t* in = as_inner(n);
+    for (size_t i = 0; i != in->count; ++i) {
+      release(in->children[i], h - 1);
+    }
+    delete in;
+  }
+
+  static size_t node_size(node_t* n, size_t h) noexcept {
+    return h ? as_inner(n)->before(n->count) : n->count;
+  }
+
+  static bool owned(node_t* n, uint64_t owner) noexcept {
+    return owner && n->owner == owner && RefCount::load(n->ref_count) == 1;
+  }
+
+  static leaf_t* copy_leaf(leaf_t const* src, size_t from, size_t n,
+                           uint64_t owner) {
+    leaf_t* result = new leaf_t(owner);
+    try {
+      std::uninitialized_copy_n(src->values() + from, n, result->values());
+    } catch (...) {
+      delete result;
+      throw;
+    }
+    result->count = n;
+    return result;
+  }
+
+  static leaf_t* editable_leaf(leaf_t* l, uint64_t owner) {
+    return owned(l, owner) ? l : copy_leaf(l, 0, l->count, owner);
+  }
+
+  static inner_t* editable_inner(inner_t* in, uint64_t owner) {
+    if (owned(in, owner)) {
+      return in;
+    }
+    inner_t* result = new inner_t(owner);
+    for (size_t i = 0; i != in->count; ++i) {
+      retain(in->children[i]);
+      result->children[i] = in->children[i];
+      result->sizes[i] = in->sizes[i];
+    }
+    result->count = in->count;
+    return result;
+  }
+
+  //  puts child in place of the one at idx, releasing the latter
+  static void replace_child(inner_t* in, size_t idx, node_t* child,
+                            size_t child_h) noexcept {
+    if (in->children[idx] != child) {
+      release(in->children[idx], child_h);
+      in->children[idx] = child;
+    }
+  }
+
+  void replace_root(node_t* root) noexcept {
+    release(root_, height_);
+    root_ = root;
+    while (height_ && root_->count == 1) {
+      node_t* child = as_inner(root_)->children[0];
+      retain(child);
+      release(root_, height_);
+      root_ = child;
+      --height_;
+    }
+  }
+
+  //  a single element under h levels of single-child nodes
+  static node_t* new_path(size_t h, T const& val, uint64_t owner) {
+    leaf_t* l = new leaf_t(owner);
+    try {
+      new(l->values()) T(val);
+    } catch (...) {
+      delete l;
+      throw;
+    }
+    l->count = 1;
+    node_t* n = l;
+    for (size_t i = 0; i != h; ++i) {
+      node_guard g{n, i};
+      inner_t* parent = new inner_t(owner);
+      g.dismiss();
+      parent->push_child(n, 1);
+      n = parent;
+    }
+    return n;
+  }
+
+  //  the edit functions return n itself, changed in place,
+  //  or a new node, leaving n as it is
+
+  //  nullptr if the subtree is full
+  static node_t* push(node_t* n, size_t h, T const& val, uint64_t owner) {
+    if (h == 0) {
+      if (n->count == B) {
+        return nullptr;
+      }
+      leaf_t* l = editable_leaf(as_leaf(n), owner);
+      node_guard g{l != n ? l : nullptr, 0};
+      new(l->values() + l->count) T(val);
+      ++l->count;
+      g.dismiss();
+      return l;
+    }
+    inner_t* in = as_inner(n);
+    size_t last = in->count - 1;
+    node_t* child = push(in->children[last], h - 1, val, owner);
+    if (!child) {
+      if (in->count == B) {
+        return nullptr;
+      }
+      inner_t* e = editable_inner(in, owner);
+      node_guard g{e != in ? e : nullptr, h};
+      node_t* path = new_path(h - 1, val, owner);
+      g.dismiss();
+      e->push_child(path, 1);
+      return e;
+    }
+    node_guard g{child != in->children[last] ? child : nullptr, h - 1};
+    inner_t* e = editable_inner(in, owner);
+    g.dismiss();
+    replace_child(e, last, child, h - 1);
+    ++e->sizes[last];
+    return e;
+  }
+
+  static node_t* set_at(node_t* n, size_t h, size_t at, T const& val,
+                        uint64_t owner) {
+    if (h == 0) {
+      leaf_t* l = editable_leaf(as_leaf(n), owner);
+      node_guard g{l != n ? l : nullptr, 0};
+      l->values()[at] = val;
+      g.dismiss();
+      return l;
+    }
+    inner_t* in = as_inner(n);
+    size_t idx = in->find(at, h);
+    node_t* child = set_at(in->children[idx], h - 1, at - in->before(idx),
+                           val, owner);
+    node_guard g{child != in->children[idx] ? child : nullptr, h - 1};
+    inner_t* e = editable_inner(in, owner);
+    g.dismiss();
+    replace_child(e, idx, child, h - 1);
+    return e;
+  }
+
+  //  the slicing functions return an owned node, sharing n if whole
+
+  //  the first k elements, 0 < k
+  static node_t* take(node_t* n, size_t h, size_t k) {
+    if (k == node_size(n, h)) {
+      retain(n);
+      return n;
+    }
+    if (h == 0) {
+      return copy_leaf(as_leaf(n), 0, k, 0);
+    }
+    inner_t* in = as_inner(n);
+    size_t idx = in->find(k - 1, h);
+    inner_t* result = new inner_t(0);
+    node_guard g{result, h};
+    for (size_t i = 0; i != idx; ++i) {
+      retain(in->children[i]);
+      result->push_child(in->children[i], in->sizes[i] - in->before(i));
+    }
+    size_t rest = k - in->before(idx);
+    result->push_child(take(in->children[idx], h - 1, rest), rest);
+    g.dismiss();
+    return result;
+  }
+
+  //  all but the first k elements, k < size
+  static node_t* drop(node_t* n, size_t h, size_t k) {
+    if (k == 0) {
+      retain(n);
+      return n;
+    }
+    if (h == 0) {
+      return copy_leaf(as_leaf(n), k, n->count - k, 0);
+    }
+    inner_t* in = as_inner(n);
+    size_t idx = in->find(k, h);
+    inner_t* result = new inner_t(0);
+    node_guard g{result, h};
+    result->push_child(drop(in->children[idx], h - 1, k - in->before(idx)),
+                       in->sizes[idx] - k);
+    for (size_t i = idx + 1; i != in->count; ++i) {
+      retain(in->children[i]);
+      result->push_child(in->children[i], in->sizes[i] - in->before(i));
+    }
+    g.dismiss();
+    return result;
+  }
+
+  //  l followed by r as up to 3 owned nodes of height max(hl, hr)
+  static size_t merge(node_t* l, size_t hl, node_t* r, size_t hr,
+                      node_t** out) {
+    if (hl == 0 && hr == 0) {
+      return merge_leaves(as_leaf(l), as_leaf(r), out);
+    }
+    size_t h = std::max(hl, hr);
+    node_t* all[2 * B + 1];
+    size_t count = 0;
+    inner_t* parents[3] = {};
+    size_t parent_count = 0;
+    try {
+      node_t* left = l;
+      size_t left_h = hl;
+      if (hl == h) {
+        inner_t* in = as_inner(l);
+        for (size_t i = 0; i + 1 != in->count; ++i) {
+          retain(in->children[i]);
+          all[count++] = in->children[i];
+        }
+        left = in->children[in->count - 1];
+        left_h = h - 1;
+      }
+      inner_t* right_in = hr == h ? as_inner(r) : nullptr;
+      node_t* right = right_in ? right_in->children[0] : r;
+      size_t right_h = right_in ? h - 1 : hr;
+      count += merge(left, left_h, right, right_h, all + count);
+      for (size_t i = 1; right_in && i != right_in->count; ++i) {
+        retain(right_in->children[i]);
+        all[count++] = right_in->children[i];
+      }
+      for (; parent_count * B < count; ++parent_count) {
+        parents[parent_count] = new inner_t(0);
+      }
+    } catch (...) {
+      for (size_t i = 0; i != count; ++i) {
+        release(all[i], h - 1);
+      }
+      for (size_t i = 0; i != parent_count; ++i) {
+        delete parents[i];
+      }
+      throw;
+    }
+    //  evenly, so that nodes on a seam stay at least half full
+    for (size_t i = 0, p = 0; p != parent_count; ++p) {
+      size_t share = count / parent_count + (p < count % parent_count);
+      for (size_t end = i + share; i != end; ++i) {
+        parents[p]->push_child(all[i], node_size(all[i], h - 1));
+      }
+    }
+    std::copy_n(parents, parent_count, out);
+    return parent_count;
+  }
+
+  static size_t merge_leaves(leaf_t* l, leaf_t* r, node_t** out) {
+    if (l->count >= B / 2 && r->count >= B / 2) {
+      retain(l);
+      retain(r);
+      out[0] = l;
+      out[1] = r;
+      return 2;
+    }
+    size_t total = l->count + r->count;
+    size_t first_count = total <= B ? total : total - total / 2;
+    leaf_t* first = new leaf_t(0);
+    node_guard g{first, 0};
+    copy_joined(l, r, 0, first_count, first);
+    out[0] = first;
+    if (first_count == total) {
+      g.dismiss();
+      return 1;
+    }
+    leaf_t* second = new leaf_t(0);
+    node_guard g_second{second, 0};
+    copy_joined(l, r, first_count, total - first_count, second);
+    out[1] = second;
+    g_second.dismiss();
+    g.dismiss();
+    return 2;
+  }
+
+  //  n elements of l followed by r, from the given one, appended to dst
+  static void copy_joined(leaf_t const* l, leaf_t const* r, size_t from,
+                          size_t n, leaf_t* dst) {
+    for (size_t i = from; i != from + n; ++i) {
+      T const& val = i < l->count ? l->values()[i]
+                                  : r->values()[i - l->count];
+      new(dst->values() + dst->count) T(val);
+      ++dst->count;
+    }
+  }
+};
+
+template <typename T, typename RefCount, size_t Bits>
+struct transient_vector;
+
+//  versions are values: every edit returns a new vector
+//  RefCount is plain_ref_count or atomic_ref_count, as for vector
+template <typename T, typename RefCount = plain_ref_count, size_t Bits = 5>
+struct persistent_vector {
+  using value_type = T;
+  using transient_type = transient_vector<T, RefCount, Bits>;
+
+  struct const_iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = T const*;
+    using reference = T const&;
+
+    const_iterator() = default;
+
+    reference operator*() const noexcept {
+      return (*v_)[i_];
+    }
+
+    pointer operator->() const noexcept {
+      return &**this;
+    }
+
+    const_iterator& operator++() noexcept {
+      ++i_;
+      return *this;
+    }
+
+    const_iterator operator++(int) noexcept {
+      const_iterator result = *this;
+      ++i_;
+      return result;
+    }
+
+    friend bool operator==(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return lhs.i_ == rhs.i_;
+    }
+
+    friend bool operator!=(const_iterator const& lhs,
+                           const_iterator const& rhs) noexcept {
+      return lhs.i_ != rhs.i_;
+    }
+
+   private:
+    friend struct persistent_vector;
+
+    const_iterator(persistent_vector const* v, size_t i) noexcept
+            : v_(v), i_(i) {
+    }
+
+    persistent_vector const* v_ = nullptr;
+    size_t i_ = 0;
+  };
+
+  persistent_vector() noexcept = default;
+
+  template <typename InputIterator, typename = std::enable_if_t<
+          std::is_base_of_v<std::input_iterator_tag, typename
+          std::iterator_traits<InputIterator>::iterator_category>>>
+  persistent_vector(InputIterator first, InputIterator last) {
+    transient_type t(*this);
+    for (; first != last; ++first) {
+      t.push_back(*first);
+    }
+    *this = t.persistent();
+  }
+
+  persistent_vector(std::initializer_list<T> init)
+          : persistent_vector(init.begin(), init.end()) {
+  }
+
+  size_t size() const noexcept {
+    return tree_.size();
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    return tree_[at];
+  }
+
+  T const& front() const noexcept {
+    return (*this)[0];
+  }
+
+  T const& back() const noexcept {
+    return (*this)[size() - 1];
+  }
+
+  const_iterator begin() const noexcept {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const noexcept {
+    return const_iterator(this, size());
+  }
+
+  persistent_vector push_back(T const& val) const {
+    persistent_vector result(*this);
+    result.tree_.push_back(val, 0);
+    return result;
+  }
+
+  persistent_vector set(size_t at, T const& val) const {
+    persistent_vector result(*this);
+    result.tree_.set(at, val, 0);
+    return result;
+  }
+
+  persistent_vector pop_back() const {
+    assert(!empty());
+    return slice(0, size() - 1);
+  }
+
+  //  elements [first, last)
+  persistent_vector slice(size_t first, size_t last) const {
+    assert(first <= last && last <= size());
+    persistent_vector result(*this);
+    result.tree_.truncate(last);
+    result.tree_.drop_front(first);
+    return result;
+  }
+
+  friend persistent_vector concat(persistent_vector const& lhs,
+                                  persistent_vector const& rhs) {
+    return persistent_vector(tree_t::concat(lhs.tree_, rhs.tree_));
+  }
+
+  transient_type transient() const {
+    return transient_type(*this);
+  }
+
+  friend bool operator==(persistent_vector const& lhs,
+                         persistent_vector const& rhs) {
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  friend bool operator!=(persistent_vector const& lhs,
+                         persistent_vector const& rhs) {
+    return !(lhs == rhs);
+  }
+
+ private:
+  friend transient_type;
+
+  using tree_t = rrb_tree<T, RefCount, Bits>;
+
+  explicit persistent_vector(tree_t tree) noexcept : tree_(std::move(tree)) {
+  }
+
+  tree_t tree_;
+};
+
+//  batch edits of a persistent_vector, copying each node once at most
+//  persistent() hands the result out and starts copying again
+template <typename T, typename RefCount, size_t Bits>
+struct transient_vector {
+  using vector_t = persistent_vector<T, RefCount, Bits>;
+
+  explicit transient_vector(vector_t const& source) noexcept
+          : tree_(source.tree_), owner_(tree_t::new_owner()) {
+  }
+
+  transient_vector(transient_vector const&) = delete;
+  transient_vector& operator=(transient_vector const&) = delete;
+
+  size_t size() const noexcept {
+    return tree_.size();
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    return tree_[at];
+  }
+
+  void push_back(T const& val) {
+    tree_.push_back(val, owner_);
+  }
+
+  void set(size_t at, T const& val) {
+    tree_.set(at, val, owner_);
+  }
+
+  void pop_back() {
+    assert(!empty());
+    tree_.truncate(size() - 1);
+  }
+
+  vector_t persistent() noexcept {
+    owner_ = tree_t::new_owner();
+    return vector_t(tree_);
+  }
+
+ private:
+  using tree_t = rrb_tree<T, RefCount, Bits>;
+
+  tree_t tree_;
+  uint64_t owner_;
+};
+
+#endif //PERSISTENT_VECTOR_H
@@ -0,0 +1,196 @@
+#ifndef RECYCLING_ALLOCATOR_H
+#define RECYCLING_ALLOCATOR_H
+
+//  freed blocks are kept in per-thread free lists, one per size class,
+//  and handed out again instead of going back to Upstream
+//  a class holds blocks of a power of two bytes, requests are rounded up
+//  a thread caches at most Budget bytes, blocks over the budget are freed
+//  a block may be freed by another thread than the one allocating it
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+#include "vector.h"
+
+//  per-thread free lists of blocks of a power of two bytes,
+//  shared by the allocators of every T with the same Budget and Upstream
+template <size_t Budget, typename Upstream>
+struct buffer_cache {
+  struct alignas(std::max_align_t) unit_t {
+    unsigned char bytes[alignof(std::max_align_t)];
+  };
+
+  using upstream_t = typename std::allocator_traits<
+          Upstream>::template rebind_alloc<unit_t>;
+  static_assert(std::allocator_traits<upstream_t>::is_always_equal::value,
+                "the blocks of one thread are freed on behalf of any other");
+
+  static constexpr size_t const CLASSES = sizeof(size_t) * 8;
+  static constexpr size_t const NO_CLASS = CLASSES;
+
+  static size_t class_bytes(size_t k) noexcept {
+    return size_t(1) << k;
+  }
+
+  //  the smallest class of at least b bytes, NO_CLASS over the budget
+  static size_t size_class(size_t b) noexcept {
+    if (b > Budget) {
+      return NO_CLASS;
+    }
+    size_t k = 0;
+    while (class_bytes(k) < std::max(b, sizeof(unit_t))) {
+      ++k;
+    }
+    return class_bytes(k) <= Budget ? k : NO_CLASS;
+  }
+
+  static void* allocate(size_t k) {
+    if (void* p = pop(k)) {
+      return p;
+    }
+    return upstream_t().allocate(class_bytes(k) / sizeof(unit_t));
+  }
+
+  static void deallocate(void* p, size_t k) noexcept {
+    if (!push(k, p)) {
+      upstream_t().deallocate(static_cast<unit_t*>(p),
+                              class_bytes(k) / sizeof(unit_t));
+    }
+  }
+
+  static size_t cached_bytes() noexcept {
+    return cache_.bytes;
+  }
+
+  static void trim() noexcept {
+    for (size_t k = 0; k != CLASSES; ++k) {
+      while (void* p = pop(k)) {
+        upstream_t().deallocate(static_cast<unit_t*>(p),
+                                class_bytes(k) / sizeof(unit_t));
+      }
+    }
+  }
+
+ private:
+
+  //  trivially destructible, so it is usable while other thread-local
+  //  objects are destroyed, closed after the release on thread exit
+  //  a free block stores the next one in its first bytes
+  struct cache_t {
+    void* heads[CLASSES];
+    size_t bytes;
+    bool closed;
+  };
+
+  struct releaser {
+    ~releaser() {
+      trim();
+      cache_.closed = true;
+    }
+  };
+
+  static inline thread_local cache_t cache_{};
+
+  static void* pop(size_t k) noexcept {
+    void* p = cache_.heads[k];
+    if (p) {
+      std::memcpy(&cache_.heads[k], p, sizeof(void*));
+      cache_.bytes -= class_bytes(k);
+    }
+    return p;
+  }
+
+  static bool push(size_t k, void* p) noexcept {
+    if (cache_.closed || cache_.bytes + class_bytes(k) > Budget) {
+      return false;
+    }
+    thread_local releaser on_exit;
+    (void) on_exit;
+    std::memcpy(p, &cache_.heads[k], sizeof(void*));
+    cache_.heads[k] = p;
+    cache_.bytes += class_bytes(k);
+    return true;
+  }
+};
+
+template <typename T, size_t Budget = (size_t(1) << 20),
+        typename Upstream = std::allocator<T>>
+struct recycling_allocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = recycling_allocator<U, Budget, typename std::allocator_traits<
+            Upstream>::template rebind_alloc<U>>;
+  };
+
+  recycling_allocator() noexcept = default;
+
+  template <typename U, typename UUpstream>
+  recycling_allocator(recycling_allocator<U, Budget, UUpstream> const&)
+          noexcept {
+  }
+
+  T* allocate(size_t n) {
+    size_t k = size_class(n);
+    if (k == cache_t::NO_CLASS) {
+      return upstream_t().allocate(n);
+    }
+    return static_cast<T*>(cache_t::allocate(k));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    size_t k = size_class(n);
+    if (k == cache_t::NO_CLASS) {
+      upstream_t().deallocate(p, n);
+    } else {
+      cache_t::deallocate(p, k);
+    }
+  }
+
+  //  bytes cached by the calling thread
+  static size_t cached_bytes() noexcept {
+    return cache_t::cached_bytes();
+  }
+
+  //  frees the blocks cached by the calling thread
+  static void trim() noexcept {
+    cache_t::trim();
+  }
+
+  friend bool operator==(recycling_allocator const&,
+                         recycling_allocator const&) noexcept {
+    return true;
+  }
+
+  friend bool operator!=(recycling_allocator const&,
+                         recycling_allocator const&) noexcept {
+    return false;
+  }
+
+ private:
+
+  using upstream_t =
+          typename std::allocator_traits<Upstream>::template rebind_alloc<T>;
+  using cache_t = buffer_cache<Budget, typename std::allocator_traits<
+          Upstream>::template rebind_alloc<std::byte>>;
+
+  //  over-aligned elements bypass the cache
+  static size_t size_class(size_t n) noexcept {
+    if (alignof(T) > alignof(std::max_align_t) ||
+        n > size_t(-1) / sizeof(T)) {
+      return cache_t::NO_CLASS;
+    }
+    return cache_t::size_class(n * sizeof(T));
+  }
+};
+
+//  opt-in recycling of buffers through a per-thread cache
+template <typename T>
+using recycling_vector = vector<T, 1, plain_ref_count,
+                                recycling_allocator<T>>;
+
+#endif //RECYCLING_ALLOCATOR_H
@@ -0,0 +1,108 @@
+#ifndef SMALL_BUFFER_H
+#define SMALL_BUFFER_H
+
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <cassert>
+
+//  up to N elements stored in place, never empty,
+//  a single element needs no counter and takes sizeof(T)
+template <typename T, size_t N>
+struct small_buffer {
+  static_assert(N > 0);
+
+  template <typename... Args>
+  explicit small_buffer(std::in_place_t, Args&& ... args) {
+    new(begin()) T(std::forward<Args>(args)...);
+    size_ = 1;
+  }
+
+  small_buffer(small_buffer const& other) {
+    std::uninitialized_copy_n(other.begin(), other.size(), begin());
+    size_ = other.size();
+  }
+
+  small_buffer(small_buffer&& other)
+  noexcept(std::is_nothrow_move_constructible_v<T>) {
+    std::uninitialized_move_n(other.begin(), other.size(), begin());
+    size_ = other.size();
+  }
+
+  //  elements are assigned pairwise, as with a single T
+  small_buffer& operator=(small_buffer const& other) {
+    assign(other.begin(), other.size());
+    return *this;
+  }
+
+  small_buffer& operator=(small_buffer&& other)
+  noexcept(std::is_nothrow_move_assignable_v<T> &&
+           std::is_nothrow_move_constructible_v<T>) {
+    assign(std::make_move_iterator(other.begin()), other.size());
+    return *this;
+  }
+
+  ~small_buffer() noexcept {
+    std::destroy_n(begin(), size());
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  T* begin() noexcept {
+    return reinterpret_cast<T*>(storage_);
+  }
+
+  T const* begin() const noexcept {
+    return reinterpret_cast<T const*>(storage_);
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&& ... args) {
+    assert(size() < N);
+    new(begin() + size()) T(std::forward<Args>(args)...);
+    size_ = size() + 1;
+  }
+
+  void pop_back() noexcept {
+    assert(size() > 1);
+    size_ = size() - 1;
+    (begin() + size())->~T();
+  }
+
+ private:
+
+  struct single_size {
+    operator size_t() const noexcept {
+      return 1;
+    }
+
+    single_size& operator=(size_t n) noexcept {
+      assert(n == 1);
+      return *this;
+    }
+  };
+
+  using size_type = std::conditional_t<N == 1, single_size, size_t>;
+
+  [[no_unique_address]] size_type size_;
+  alignas(T) unsigned char storage_[N * sizeof(T)];
+
+  template <typename InputIterator>
+  void assign(InputIterator first, size_t n) {
+    size_t common = std::min(size(), n);
+    std::copy_n(first, common, begin());
+    if (n > size()) {
+      std::uninitialized_copy_n(std::next(first, common), n - common,
+                                begin() + common);
+    } else {
+      std::destroy_n(begin() + n, size() - n);
+    }
+    size_ = n;
+  }
+};
+
+#endif //SMALL_BUFFER_H
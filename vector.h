@@ -6,8 +6,12 @@
 #define VECTOR_H
 
 //  exception-safe
-//  small-object
-//  sizeof(vector<T> <= sizeof(void*) + max(sizeof(void*), sizeof(T))
+//  small-object, up to N elements in place
+//  sizeof(vector<T, N>) <= max(sizeof(void*), sizeof(small_buffer<T, N>))
+//                          + max(sizeof(void*), alignof(T)),
+//  small_buffer<T, 1> is a single T, for N > 1 it adds a size_t,
+//  so sizeof(vector<T>) <= sizeof(void*) + max(sizeof(void*), sizeof(T))
+//  if alignof(T) <= sizeof(void*), a stateful allocator adds its size
 //  copy-on-write
 //  1 allocation max
 //  no default constructor
@@ -17,63 +21,140 @@
 #include <utility>
 #include <cassert>
 #include <algorithm>
+#include <memory_resource>
 
 #include "basic_vector.h"
+#include "small_buffer.h"
+#include "byte_compare.h"
 
+//  raw storage of a vector, see vector::mutable_span
 template <typename T>
+struct vector_span {
+  T* begin() const noexcept {
+    return data_;
+  }
+
+  T* end() const noexcept {
+    return data_ + size_;
+  }
+
+  T* data() const noexcept {
+    return data_;
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  T& operator[](size_t at) const noexcept {
+    assert(at < size_);
+    return data_[at];
+  }
+
+  T* data_;
+  size_t size_;
+};
+
+template <typename T, size_t N, typename RefCount, typename Allocator,
+        typename Growth, size_t DataAlign>
+struct vector_slice;
+
+//  N elements are kept in place before moving to a shared buffer
+//  RefCount is plain_ref_count or atomic_ref_count, see shared_vector
+//  a buffer always comes from an allocator equal to the vector's,
+//  copies share it only if their allocators compare equal
+//  Growth is one of the growth policies from basic_vector.h
+//  DataAlign aligns the data of a buffer, see cache_aligned_vector
+template <typename T, size_t N = 1, typename RefCount = plain_ref_count,
+        typename Allocator = std::allocator<T>,
+        typename Growth = doubling_growth,
+        size_t DataAlign = alignof(T)>
 struct vector {
   using value_type = T;
+  using allocator_type = Allocator;
 
-  using iterator = typename basic_vector<T>::iterator;
-  using const_iterator = typename basic_vector<T>::const_iterator;
+  using iterator = T*;
+  using const_iterator = T const*;
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   vector() noexcept = default;
 
-  vector(size_t count, T const& value) {
-    reserve(count);
-    while (count--) {
-      push_back(value);
-    }
+  explicit vector(Allocator const& alloc) noexcept : alloc_(alloc) {
   }
 
-  explicit vector(size_t count) {
-    reserve(count);
-    while (count--) {
-      emplace_back();
-    }
+  vector(size_t count, T const& value, Allocator const& alloc = Allocator())
+          : alloc_(alloc) {
+    push_back(value, count);
+  }
+
+  explicit vector(size_t count, Allocator const& alloc = Allocator())
+          : alloc_(alloc) {
+    append(count);
   }
 
-  vector(vector const& other) : data_(other.data_) {
+  vector(vector const& other)
+          : vector(other, alloc_traits::select_on_container_copy_construction(
+          other.alloc_)) {
+  }
+
+  //  the buffer of other is copied into one from alloc unless they are equal
+  vector(vector const& other, Allocator const& alloc) : alloc_(alloc) {
+    if (other.holds_vector() && !equal_allocators(alloc_, other.alloc_)) {
+      data_ = other.copy_buffer(alloc_);
+    } else {
+      data_ = other.data_;
+    }
   }
 
   template <typename InputIterator, typename = std::_RequireInputIter<InputIterator>>
-  vector(InputIterator first, InputIterator last) {
-    reserve(std::distance(first, last));
-    std::copy(first, last, std::back_inserter(*this));
+  vector(InputIterator first, InputIterator last,
+         Allocator const& alloc = Allocator()) : alloc_(alloc) {
+    insert(cend(), first, last);
   }
 
-  vector(std::initializer_list<T> init) : vector(init.begin(), init.end()) {
+  vector(std::initializer_list<T> init, Allocator const& alloc = Allocator())
+          : vector(init.begin(), init.end(), alloc) {
   }
 
   template <typename InputIterator>
   void assign(InputIterator first, InputIterator last) {
-    *this = vector(first, last);
+    *this = vector(first, last, alloc_);
   }
 
-  vector(vector&& other) {
-    swap(other);
+  vector(vector&& other) : alloc_(other.alloc_) {
+    std::swap(data_, other.data_);
   }
 
+  //  alloc_ follows the propagate_on_container_* traits, a buffer from
+  //  an unequal allocator which is not taken over is copied into alloc_
+
   vector& operator=(vector const& other) {
-    vector copy_(other);
-    swap(copy_);
+    if (this == &other) {
+      return *this;
+    }
+    if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+      vector copy_(other, other.alloc_);
+      std::swap(data_, copy_.data_);
+      alloc_ = other.alloc_;
+    } else {
+      vector copy_(other, alloc_);
+      std::swap(data_, copy_.data_);
+    }
     return *this;
   }
 
   vector& operator=(vector&& other) {
-    swap(other);
+    if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+      std::swap(data_, other.data_);
+      using std::swap;
+      swap(alloc_, other.alloc_);
+    } else if (equal_allocators(alloc_, other.alloc_)) {
+      std::swap(data_, other.data_);
+    } else {
+      vector copy_(other, alloc_);
+      std::swap(data_, copy_.data_);
+    }
     return *this;
   }
 
@@ -83,16 +164,31 @@ struct vector {
     if (holds_nothing()) {
       return;
     }
-    if (holds_value()) {
+    if (holds_small() || !as_vector().unique()) {
       data_ = empty_t();
       return;
     }
-    as_vector().detach();
     as_vector().clear();
   }
 
+  //  both buffers are copied if the allocators stay and are unequal
   void swap(vector& other) {
-    std::swap(data_, other.data_);
+    if constexpr (alloc_traits::propagate_on_container_swap::value) {
+      std::swap(data_, other.data_);
+      using std::swap;
+      swap(alloc_, other.alloc_);
+    } else if (equal_allocators(alloc_, other.alloc_)) {
+      std::swap(data_, other.data_);
+    } else {
+      vector ours(other, alloc_);
+      vector theirs(*this, other.alloc_);
+      std::swap(data_, ours.data_);
+      std::swap(other.data_, theirs.data_);
+    }
+  }
+
+  Allocator get_allocator() const noexcept {
+    return alloc_;
   }
 
   friend void swap(vector& lhs, vector& rhs) {
@@ -103,15 +199,15 @@ struct vector {
     if (holds_nothing()) {
       return 0;
     }
-    if (holds_value()) {
-      return 1;
+    if (holds_small()) {
+      return as_small().size();
     }
     return as_vector().size();
   }
 
   size_t capacity() const noexcept {
-    if (holds_nothing() || holds_value()) {
-      return 1;
+    if (!holds_vector()) {
+      return N;
     }
     return as_vector().capacity();
   }
@@ -124,8 +220,8 @@ struct vector {
     if (holds_nothing()) {
       return nullptr;
     }
-    if (holds_value()) {
-      return std::addressof(as_value());
+    if (holds_small()) {
+      return as_small().begin();
     }
     as_vector().detach();
     return as_vector().begin();
@@ -135,12 +231,36 @@ struct vector {
     if (holds_nothing()) {
       return nullptr;
     }
-    if (holds_value()) {
-      return std::addressof(as_value());
+    if (holds_small()) {
+      return as_small().begin();
     }
     return as_vector().begin();
   }
 
+  //  unshares the buffer once, the span stays valid until
+  //  the size or capacity changes or the vector is copied
+  vector_span<T> mutable_span() {
+    T* first = begin();
+    return {first, size()};
+  }
+
+  //  f(T*, size_t) on the elements, unshared once
+  template <typename F>
+  void mutate(F f) {
+    vector_span<T> s = mutable_span();
+    f(s.data(), s.size());
+  }
+
+  //  never copy a shared buffer
+
+  const_iterator cbegin() const noexcept {
+    return begin();
+  }
+
+  const_iterator cend() const noexcept {
+    return end();
+  }
+
   T* data() {
     return begin();
   }
@@ -200,10 +320,13 @@ struct vector {
   }
 
   friend bool operator==(vector const& lhs, vector const& rhs) {
-    if (lhs.size() != rhs.size()) {
-      return false;
-    }
-    return std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    return lhs.size() == rhs.size() &&
+           range_equal(lhs.cbegin(), rhs.cbegin(), lhs.size());
+  }
+
+  //  a buffer caches the hash, see basic_vector::hash
+  size_t hash() const {
+    return holds_vector() ? as_vector().hash() : hash_range(cbegin(), size());
   }
 
   friend bool operator!=(vector const& lhs, vector const& rhs) {
@@ -211,10 +334,7 @@ struct vector {
   }
 
   friend bool operator<(vector const& lhs, vector const& rhs) {
-    return std::lexicographical_compare(lhs.begin(),
-                                        lhs.end(),
-                                        rhs.begin(),
-                                        rhs.end());
+    return range_less(lhs.cbegin(), lhs.size(), rhs.cbegin(), rhs.size());
   }
 
   friend bool operator>(vector const& lhs, vector const& rhs) {
@@ -232,16 +352,19 @@ struct vector {
   template <typename... Args>
   void emplace_back(Args&& ... args) {
     if (holds_nothing()) {
-      data_ = T(std::forward<Args>(args)...);
+      data_ = small_t(std::in_place, std::forward<Args>(args)...);
       return;
     }
-    if (holds_value()) {
-      auto new_data = basic_vector<T>(as_value());
+    if (holds_small()) {
+      if (size() < N) {
+        as_small().emplace_back(std::forward<Args>(args)...);
+        return;
+      }
+      auto new_data = to_buffer(0);
       new_data.emplace_back(std::forward<Args>(args)...);
       data_ = new_data;
       return;
     }
-    as_vector().detach();
     as_vector().emplace_back(std::forward<Args>(args)...);
   }
 
@@ -251,40 +374,43 @@ struct vector {
   }
 
   void push_back(T const& val, size_t n) {
-    size_t sz = size();
-    reserve(sz + n);
-    while (n--) {
-      try {
-        push_back(val);
-      } catch (...) {
-        erase(begin() + sz, end());
-        throw;
-      }
+    if (n == 1) {
+      push_back(val);
+    } else if (fits_in_place(n)) {
+      insert_in_place(size(), n, [&] {
+        emplace_back(val);
+      });
+    } else if (n) {
+      with_buffer(size() + n, [&](buffer_t& buffer) {
+        buffer.append(n, val);
+      });
     }
   }
 
   void pop_back() {
     assert(!empty());
-    if (holds_value()) {
-      clear();
-      return;
-    }
-    as_vector().detach();
-    as_vector().pop_back();
+    truncate(size() - 1);
   }
 
   void reserve(size_t n) {
     if (n <= capacity()) {
       return;
     }
-    if (holds_nothing()) {
-      data_ = basic_vector<T>();
+    if (holds_vector()) {
+      as_vector().reserve(n);
+      return;
     }
-    if (holds_value()) {
-      data_ = basic_vector<T>(std::move_if_noexcept(as_value()));
+    auto new_data = buffer_t::with_capacity(n, alloc_);
+    if (holds_small()) {
+      T* first = as_small().begin();
+      if constexpr (std::__move_if_noexcept_cond<T>::value) {
+        new_data.insert(0, first, first + size());
+      } else {
+        new_data.insert(0, std::make_move_iterator(first),
+                        std::make_move_iterator(first + size()));
+      }
     }
-    as_vector().detach();
-    as_vector().reserve(n);
+    data_ = new_data;
   }
 
   void shrink_to_fit() {
@@ -295,13 +421,19 @@ struct vector {
 
   template <typename... Args>
   iterator emplace(const_iterator pos, Args&& ... args) {
-    auto pos_i = pos - begin();
-    emplace_back(std::forward<Args>(args)...);
-    pos = begin() + pos_i;
-    for (auto it = end() - 1; it != pos; --it) {
-      std::iter_swap(it, it - 1);
+    size_t pos_i = index_of(pos);
+    if (fits_in_place(1)) {
+      insert_in_place(pos_i, 1, [&] {
+        emplace_back(std::forward<Args>(args)...);
+      });
+    } else if (holds_small()) {
+      auto new_data = to_buffer(0);
+      new_data.emplace(pos_i, std::forward<Args>(args)...);
+      data_ = new_data;
+    } else {
+      as_vector().emplace(pos_i, std::forward<Args>(args)...);
     }
-    return iterator(pos);
+    return begin() + pos_i;
   }
 
   template <typename S, typename = std::enable_if_t<std::is_convertible_v<S, T>>>
@@ -309,26 +441,98 @@ struct vector {
     return emplace(pos, std::forward<S>(val));
   }
 
+  iterator insert(const_iterator pos, size_t n, T const& val) {
+    size_t pos_i = index_of(pos);
+    if (n == 1) {
+      return emplace(pos, val);
+    }
+    if (fits_in_place(n)) {
+      insert_in_place(pos_i, n, [&] {
+        emplace_back(val);
+      });
+    } else if (n) {
+      with_buffer(size() + n, [&](buffer_t& buffer) {
+        buffer.insert(pos_i, n, val);
+      });
+    }
+    return begin() + pos_i;
+  }
+
+  template <typename InputIterator, typename = std::_RequireInputIter<InputIterator>>
+  iterator insert(const_iterator pos, InputIterator first, InputIterator last) {
+    size_t pos_i = index_of(pos);
+    using category = typename std::iterator_traits<InputIterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+      auto n = std::distance(first, last);
+      if (n == 1) {
+        return emplace(pos, *first);
+      }
+      if (fits_in_place(n)) {
+        insert_in_place(pos_i, n, [&] {
+          emplace_back(*first);
+          ++first;
+        });
+      } else if (n) {
+        with_buffer(size() + n, [&](buffer_t& buffer) {
+          buffer.insert(pos_i, first, last);
+        });
+      }
+    } else {
+      size_t sz = size();
+      try {
+        std::copy(first, last, std::back_inserter(*this));
+      } catch (...) {
+        truncate(sz);
+        throw;
+      }
+      std::rotate(begin() + pos_i, begin() + sz, end());
+    }
+    return begin() + pos_i;
+  }
+
+  iterator insert(const_iterator pos, std::initializer_list<T> init) {
+    return insert(pos, init.begin(), init.end());
+  }
+
   iterator erase(const_iterator pos) {
     return erase(pos, pos + 1);
   }
 
   iterator erase(const_iterator first, const_iterator last) {
-    auto result = iterator(last);
-    if (first == last) {
-      return result;
-    }
-    size_t last_i = last - begin();
-    size_t sz = size();
-    size_t rotate = last_i % sz;
-    std::rotate(begin(), begin() + rotate, end());
-    size_t new_first = ((first == begin() ? last_i : 0) - rotate + sz) % sz;
+    size_t first_i = index_of(first);
     size_t n = last - first;
-    while (n--) {
-      pop_back();
+    if (!n) {
+      return begin() + first_i;
     }
-    std::rotate(begin(), begin() + new_first, end());
-    return result;
+    if (n == size()) {
+      clear();
+      return end();
+    }
+    if (holds_small()) {
+      T* p = as_small().begin();
+      std::move(p + first_i + n, p + size(), p + first_i);
+      truncate(size() - n);
+    } else {
+      as_vector().erase(first_i, n);
+    }
+    return begin() + first_i;
+  }
+
+  //  removes all elements satisfying pred in one pass,
+  //  returns the number of removed ones
+  template <typename Predicate>
+  size_t erase_if(Predicate pred) {
+    if (holds_nothing()) {
+      return 0;
+    }
+    if (holds_small()) {
+      T* first = as_small().begin();
+      T* last = first + size();
+      T* new_last = std::remove_if(first, last, pred);
+      truncate(new_last - first);
+      return last - new_last;
+    }
+    return as_vector().erase_if(pred);
   }
 
   void resize(size_t n) {
@@ -337,58 +541,191 @@ struct vector {
 
   void resize(size_t n, T const& val) {
     if (n <= size()) {
-      erase(begin() + n, end());
+      truncate(n);
       return;
     }
     push_back(val, n - size());
   }
 
+  //  new elements are left indeterminate, to be overwritten,
+  //  for trivially default-constructible T
+  void resize_for_overwrite(size_t n) {
+    if (n <= size()) {
+      truncate(n);
+      return;
+    }
+    append_uninitialized(n - size());
+  }
+
+  //  a buffer only bumps its size, elements in place are zeroed
+  void append_uninitialized(size_t n) {
+    static_assert(std::is_trivially_default_constructible_v<T>);
+    if (fits_in_place(n) || n == 1) {
+      append(n);
+    } else if (n) {
+      with_buffer(size() + n, [&](buffer_t& buffer) {
+        buffer.append_uninitialized(n);
+      });
+    }
+  }
+
  private:
 
+  friend struct vector_slice<T, N, RefCount, Allocator, Growth, DataAlign>;
+  friend struct mapped_file<vector>;
+
   using empty_t = std::monostate;
-  using union_t = std::variant<empty_t, T, basic_vector<T>>;
+  using small_t = small_buffer<T, N>;
+  using buffer_t = basic_vector<T, std::max<size_t>(4, 2 * N), RefCount,
+                                Allocator, Growth, DataAlign>;
+  using union_t = std::variant<empty_t, small_t, buffer_t>;
+  using alloc_traits = std::allocator_traits<Allocator>;
 
   union_t data_;
+  //  a buffer keeps its own copy, always equal to this one
+  [[no_unique_address]] Allocator alloc_;
+
+  static bool equal_allocators(Allocator const& a,
+                               Allocator const& b) noexcept {
+    if constexpr (alloc_traits::is_always_equal::value) {
+      return true;
+    } else {
+      return a == b;
+    }
+  }
 
+  //  a buffer from alloc with a copy of our elements
+  buffer_t copy_buffer(Allocator const& alloc) const {
+    auto result = buffer_t::with_capacity(size(), alloc);
+    result.insert(0, cbegin(), cend());
+    return result;
+  }
+
+  //  also true if a throwing move left data_ valueless
   bool holds_nothing() const noexcept {
-    return std::holds_alternative<empty_t>(data_);
+    return !holds_small() && !holds_vector();
   }
 
-  bool holds_value() const noexcept {
-    return std::holds_alternative<T>(data_);
+  bool holds_small() const noexcept {
+    return std::holds_alternative<small_t>(data_);
   }
 
   bool holds_vector() const noexcept {
-    return std::holds_alternative<basic_vector<T>>(data_);
+    return std::holds_alternative<buffer_t>(data_);
   }
 
-  T& as_value() noexcept {
-    return std::get<T>(data_);
+  small_t& as_small() noexcept {
+    return std::get<small_t>(data_);
   }
 
-  T const& as_value() const noexcept {
-    return std::get<T>(data_);
+  small_t const& as_small() const noexcept {
+    return std::get<small_t>(data_);
   }
 
-  basic_vector<T>& as_vector() noexcept {
-    return std::get<basic_vector<T>>(data_);
+  buffer_t& as_vector() noexcept {
+    return std::get<buffer_t>(data_);
   }
 
-  basic_vector<T> const& as_vector() const noexcept {
-    return std::get<basic_vector<T>>(data_);
+  buffer_t const& as_vector() const noexcept {
+    return std::get<buffer_t>(data_);
   }
 
-  void resize_unspecified(size_t n, std::false_type) {
+  bool shares_buffer() const noexcept {
+    return holds_vector() && !as_vector().unique();
+  }
+
+  size_t index_of(const_iterator pos) const noexcept {
+    return pos - begin();
+  }
+
+  //  a buffer of capacity cap holding a copy of the small-object state
+  buffer_t to_buffer(size_t cap) const {
+    auto result = buffer_t::with_capacity(cap, alloc_);
+    if (holds_small()) {
+      T const* first = as_small().begin();
+      result.insert(0, first, first + size());
+    }
+    return result;
+  }
+
+  bool fits_in_place(size_t n) const noexcept {
+    return n && !holds_vector() && size() + n <= N;
+  }
+
+  //  calls emplace_one() n times to append to the in-place storage
+  //  and rotates the new elements to pos
+  template <typename F>
+  void insert_in_place(size_t pos, size_t n, F emplace_one) {
+    size_t sz = size();
+    try {
+      while (n--) {
+        emplace_one();
+      }
+    } catch (...) {
+      truncate(sz);
+      throw;
+    }
+    T* first = as_small().begin();
+    std::rotate(first + pos, first + sz, first + size());
+  }
+
+  //  applies f to the buffer, a small-object state is first copied to
+  //  a buffer of capacity cap which replaces it if f succeeds
+  template <typename F>
+  void with_buffer(size_t cap, F f) {
+    if (holds_vector()) {
+      f(as_vector());
+      return;
+    }
+    auto new_data = to_buffer(cap);
+    f(new_data);
+    data_ = new_data;
+  }
+
+  //  appends n value-initialized elements
+  void append(size_t n) {
+    if (n == 1) {
+      emplace_back();
+    } else if (fits_in_place(n)) {
+      insert_in_place(size(), n, [&] {
+        emplace_back();
+      });
+    } else if (n) {
+      with_buffer(size() + n, [&](buffer_t& buffer) {
+        buffer.append(n);
+      });
+    }
+  }
+
+  //  a shared buffer is replaced with a copy of the first n elements only
+  void truncate(size_t n) {
     assert(n <= size());
-    erase(begin() + n, end());
+    if (n == size()) {
+      return;
+    }
+    if (n == 0) {
+      clear();
+      return;
+    }
+    if (holds_small()) {
+      while (size() != n) {
+        as_small().pop_back();
+      }
+      return;
+    }
+    as_vector().erase(n, size() - n);
+  }
+
+  void resize_unspecified(size_t n, std::false_type) {
+    truncate(n);
   }
 
   void resize_unspecified(size_t n, std::true_type) {
     if (n <= size()) {
-      erase(begin() + n, end());
+      truncate(n);
       return;
     }
-    push_back(T(), n - size());
+    append(n - size());
   }
 };
 
@@ -396,4 +733,40 @@ template <typename InputIterator> vector(InputIterator first,
                                          InputIterator last) ->
 vector<typename std::iterator_traits<InputIterator>::value_type>;
 
+template <typename T, size_t N, typename RefCount, typename Allocator,
+        typename Growth, size_t DataAlign, typename Predicate>
+size_t erase_if(vector<T, N, RefCount, Allocator, Growth, DataAlign>& v,
+                Predicate pred) {
+  return v.erase_if(pred);
+}
+
+namespace std {
+  template <typename T, size_t N, typename RefCount, typename Allocator,
+          typename Growth, size_t DataAlign>
+  struct hash<::vector<T, N, RefCount, Allocator, Growth, DataAlign>> {
+    size_t operator()(::vector<T, N, RefCount, Allocator, Growth,
+                               DataAlign> const& v) const {
+      return v.hash();
+    }
+  };
+}
+
+//  copies may be handed to other threads in O(1),
+//  a single object still must not be used concurrently
+template <typename T>
+using shared_vector = vector<T, 1, atomic_ref_count>;
+
+//  a buffer starts on a cache line boundary,
+//  an element kept in place is aligned as T only
+template <typename T>
+using cache_aligned_vector = vector<T, 1, plain_ref_count,
+                                    std::allocator<T>, doubling_growth,
+                                    cache_line_size>;
+
+namespace pmr {
+  template <typename T>
+  using vector = ::vector<T, 1, plain_ref_count,
+                          std::pmr::polymorphic_allocator<T>>;
+}
+
 #endif //VECTOR_H
@@ -0,0 +1,151 @@
+#ifndef VECTOR_SLICE_H
+#define VECTOR_SLICE_H
+
+//  a window of a vector sharing its buffer, no allocation to take one
+//  the slice keeps a copy of the vector, so the buffer stays alive
+//  a write copies the window alone if the buffer is shared,
+//  to_vector shares the buffer if the window covers it all
+
+#include <cassert>
+#include <algorithm>
+
+#include "vector.h"
+
+template <typename T, size_t N = 1, typename RefCount = plain_ref_count,
+        typename Allocator = std::allocator<T>,
+        typename Growth = doubling_growth,
+        size_t DataAlign = alignof(T)>
+struct vector_slice {
+  using value_type = T;
+  using vector_t = vector<T, N, RefCount, Allocator, Growth, DataAlign>;
+
+  using iterator = T*;
+  using const_iterator = T const*;
+
+  vector_slice() noexcept = default;
+
+  //  the whole of source
+  vector_slice(vector_t const& source)
+          : source_(source, source.get_allocator()), offset_(0),
+            size_(source.size()) {
+  }
+
+  vector_slice(vector_t const& source, size_t pos, size_t n)
+          : source_(source, source.get_allocator()), offset_(pos), size_(n) {
+    assert(pos + n <= source.size());
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  const_iterator begin() const noexcept {
+    return source_.cbegin() + offset_;
+  }
+
+  const_iterator end() const noexcept {
+    return begin() + size_;
+  }
+
+  const_iterator cbegin() const noexcept {
+    return begin();
+  }
+
+  const_iterator cend() const noexcept {
+    return end();
+  }
+
+  iterator begin() {
+    if (source_.shares_buffer()) {
+      source_ = vector_t(cbegin(), cend(), source_.get_allocator());
+      offset_ = 0;
+    }
+    return source_.begin() + offset_;
+  }
+
+  iterator end() {
+    return begin() + size_;
+  }
+
+  T const* data() const noexcept {
+    return begin();
+  }
+
+  T* data() {
+    return begin();
+  }
+
+  T const& operator[](size_t at) const noexcept {
+    assert(at < size_);
+    return begin()[at];
+  }
+
+  T& operator[](size_t at) {
+    assert(at < size_);
+    return begin()[at];
+  }
+
+  T const& front() const noexcept {
+    return (*this)[0];
+  }
+
+  T& front() {
+    return (*this)[0];
+  }
+
+  T const& back() const noexcept {
+    return (*this)[size_ - 1];
+  }
+
+  T& back() {
+    return (*this)[size_ - 1];
+  }
+
+  vector_slice subslice(size_t pos, size_t n) const {
+    assert(pos + n <= size_);
+    return vector_slice(source_, offset_ + pos, n);
+  }
+
+  vector_t to_vector() const {
+    if (offset_ == 0 && size_ == source_.size()) {
+      return source_;
+    }
+    return vector_t(cbegin(), cend(), source_.get_allocator());
+  }
+
+  friend bool operator==(vector_slice const& lhs, vector_slice const& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+  friend bool operator!=(vector_slice const& lhs, vector_slice const& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(vector_slice const& lhs, vector_slice const& rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(),
+                                        rhs.begin(), rhs.end());
+  }
+
+ private:
+
+  vector_t source_;
+  size_t offset_ = 0;
+  size_t size_ = 0;
+};
+
+template <typename T, size_t N, typename RefCount, typename Allocator,
+        typename Growth, size_t DataAlign>
+vector_slice(vector<T, N, RefCount, Allocator, Growth, DataAlign> const&) ->
+vector_slice<T, N, RefCount, Allocator, Growth, DataAlign>;
+
+template <typename T, size_t N, typename RefCount, typename Allocator,
+        typename Growth, size_t DataAlign>
+vector_slice(vector<T, N, RefCount, Allocator, Growth, DataAlign> const&,
+             size_t, size_t) ->
+vector_slice<T, N, RefCount, Allocator, Growth, DataAlign>;
+
+#endif //VECTOR_SLICE_H
@@ -1,12 +1,52 @@
 #include <gtest/gtest.h>
 #include <numeric>
+#include <limits>
+#include <random>
+#include <unordered_set>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <thread>
 #include "fault_injection.h"
 #include "counted.h"
 #include "vector.h"
+#include "compact_vector.h"
+#include "chunked_vector.h"
+#include "vector_slice.h"
+#include "persistent_vector.h"
+#include "mremap_allocator.h"
+#include "huge_page_allocator.h"
+#include "recycling_allocator.h"
+#include "background_reclaimer.h"
+#include "mapped_file.h"
 
 typedef vector<counted> container;
 typedef vector<int> container_int;
 
+namespace {
+  struct hash_counted {
+    int value;
+
+    friend bool operator==(hash_counted const& lhs, hash_counted const& rhs) {
+      return lhs.value == rhs.value;
+    }
+
+    static size_t hashes;
+  };
+
+  size_t hash_counted::hashes = 0;
+}
+
+namespace std {
+  template <>
+  struct hash<hash_counted> {
+    size_t operator()(hash_counted const& x) const {
+      ++hash_counted::hashes;
+      return std::hash<int>()(x.value);
+    }
+  };
+}
+
 TEST(correctness, default_ctor)
 {
     faulty_run([]
@@ -1032,6 +1072,44 @@ TEST(my_tests, max_align_t) {
   });
 }
 
+TEST(my_tests, over_aligned) {
+  faulty_run([] {
+    struct alignas(64) padded {
+      int value;
+    };
+    vector<padded> v;
+    for (int i = 0; i != 100; ++i) {
+      v.push_back(padded{i});
+      ASSERT_EQ(reinterpret_cast<uintptr_t>(v.data()) % 64, 0u);
+    }
+    ASSERT_EQ(v[99].value, 99);
+    auto w = v;
+    w.erase(w.begin());
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(w.data()) % 64, 0u);
+    ASSERT_EQ(w[0].value, 1);
+  });
+}
+
+TEST(my_tests, cache_aligned_data) {
+  faulty_run([] {
+    cache_aligned_vector<char> v;
+    for (char i = 0; i != 100; ++i) {
+      v.push_back(i);
+      if (v.size() > 1) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(v.data()) % cache_line_size,
+                  0u);
+      }
+    }
+    ASSERT_EQ(v[99], 99);
+    v.shrink_to_fit();
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(v.data()) % cache_line_size, 0u);
+    basic_vector<int, 4, plain_ref_count, std::allocator<int>,
+            doubling_growth, 128> b;
+    b.push_back(1);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(b.begin()) % 128, 0u);
+  });
+}
+
 TEST(my_tests, count_value_constructor) {
   faulty_run([] {
     counted::no_new_instances_guard g;
@@ -1254,4 +1332,1304 @@ TEST(my_tests, resize) {
     ci.resize(0);
     ASSERT_EQ(0u, ci.size());
   });
-}
\ No newline at end of file
+}
+
+TEST(my_tests, detach_keeps_shared_elements) {
+  faulty_run([] {
+    vector<std::string> a;
+    for (size_t i = 0; i != 5; ++i) {
+      a.push_back(std::string(32, char('a' + i)));
+    }
+    vector<std::string> b = a;
+    b[0] = "x";
+    b.shrink_to_fit();
+    vector<std::string> c = a;
+    c.push_back(c[0]);
+    for (size_t i = 0; i != 5; ++i) {
+      ASSERT_EQ(a[i], std::string(32, char('a' + i)));
+      ASSERT_EQ(c[i], a[i]);
+    }
+    ASSERT_EQ(b[0], "x");
+    ASSERT_EQ(c[5], a[0]);
+  });
+}
+
+TEST(my_tests, trivially_relocatable_growth) {
+  faulty_run([] {
+    container_int c;
+    for (int i = 0; i != 1000; ++i) {
+      c.push_back(i);
+    }
+    container_int d = c;
+    d.reserve(5000);
+    c.shrink_to_fit();
+    ASSERT_EQ(c.capacity(), 1000u);
+    for (int i = 0; i != 1000; ++i) {
+      ASSERT_EQ(c[i], i);
+      ASSERT_EQ(d[i], i);
+    }
+  });
+}
+
+TEST(my_tests, shared_vector_threads) {
+  shared_vector<std::string> v;
+  for (size_t i = 0; i != 1000; ++i) {
+    v.push_back(std::to_string(i));
+  }
+  std::vector<std::thread> readers;
+  for (size_t t = 0; t != 8; ++t) {
+    readers.emplace_back([snapshot = v, t]() mutable {
+      for (size_t k = 0; k != 100; ++k) {
+        shared_vector<std::string> copy = snapshot;
+        if (k % 10 == t % 10) {
+          copy[0] = "changed";
+        }
+        EXPECT_EQ(copy.size(), 1000u);
+        EXPECT_EQ(static_cast<shared_vector<std::string> const&>(copy)[999],
+                  "999");
+      }
+    });
+  }
+  v.push_back("1000");
+  for (auto& r : readers) {
+    r.join();
+  }
+  EXPECT_EQ(v[0], "0");
+  EXPECT_EQ(v.size(), 1001u);
+}
+
+TEST(my_tests, insert_range) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    std::vector<int> v = {1, 2, 3, 4, 5, 6, 7, 8};
+    container c;
+    c.insert(c.begin(), v.begin(), v.begin() + 2);
+    c.insert(c.end(), v.begin() + 6, v.end());
+    c.insert(c.begin() + 2, v.begin() + 2, v.begin() + 6);
+    ASSERT_EQ(c.size(), 8u);
+    for (size_t i = 0; i != 8; ++i) {
+      ASSERT_EQ(c[i], v[i]);
+    }
+    container d = c;
+    c.insert(c.begin() + 1, 3, c[0]);
+    ASSERT_EQ(c.size(), 11u);
+    ASSERT_EQ(d.size(), 8u);
+    for (size_t i = 0; i != 4; ++i) {
+      ASSERT_EQ(c[i], 1);
+    }
+    ASSERT_EQ(c[4], 2);
+    ASSERT_EQ(c[10], 8);
+    c.insert(c.begin() + 4, {10, 11});
+    ASSERT_EQ(c[4], 10);
+    ASSERT_EQ(c[5], 11);
+    ASSERT_EQ(c[6], 2);
+  });
+}
+
+TEST(my_tests, insert_input_iterator) {
+  faulty_run([] {
+    std::istringstream in("3 4 5");
+    container_int c = {1, 2, 6};
+    auto it = c.insert(c.begin() + 2, std::istream_iterator<int>(in),
+                       std::istream_iterator<int>());
+    ASSERT_EQ(*it, 3);
+    ASSERT_EQ(c.size(), 6u);
+    for (int i = 0; i != 6; ++i) {
+      ASSERT_EQ(c[i], i + 1);
+    }
+  });
+}
+
+TEST(my_tests, insert_in_place_strings) {
+  faulty_run([] {
+    vector<std::string> v;
+    v.reserve(16);
+    v.push_back("a");
+    v.push_back("e");
+    std::string mid[] = {"b", "c", "d"};
+    v.insert(v.begin() + 1, mid, mid + 3);
+    v.insert(v.begin(), v[4]);
+    v.insert(v.end(), 2, v[0]);
+    ASSERT_EQ(v.capacity(), 16u);
+    std::string expected[] = {"e", "a", "b", "c", "d", "e", "e", "e"};
+    ASSERT_EQ(v.size(), 8u);
+    for (size_t i = 0; i != 8; ++i) {
+      ASSERT_EQ(v[i], expected[i]);
+    }
+  });
+}
+
+TEST(my_tests, erase_return) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    container c = {1, 2, 3, 4, 5, 6};
+    container d = c;
+    auto it = c.erase(c.begin() + 1, c.begin() + 3);
+    ASSERT_EQ(*it, 4);
+    it = c.erase(c.end() - 1);
+    ASSERT_TRUE(it == c.end());
+    ASSERT_EQ(c.size(), 3u);
+    ASSERT_EQ(c[0], 1);
+    ASSERT_EQ(c[1], 4);
+    ASSERT_EQ(c[2], 5);
+    ASSERT_EQ(d.size(), 6u);
+    ASSERT_EQ(d[1], 2);
+  });
+}
+
+TEST(my_tests, erase_if) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    container c;
+    for (int i = 0; i != 20; ++i) {
+      c.push_back(i);
+    }
+    container d = c;
+    auto odd = [](counted const& x) { return x % 2 != 0; };
+    ASSERT_EQ(erase_if(c, odd), 10u);
+    ASSERT_EQ(c.size(), 10u);
+    ASSERT_EQ(d.size(), 20u);
+    for (int i = 0; i != 10; ++i) {
+      ASSERT_EQ(c[i], 2 * i);
+    }
+    auto big = [](counted const& x) { return x >= 5; };
+    ASSERT_EQ(d.erase_if(big), 15u);
+    ASSERT_EQ(d.size(), 5u);
+    ASSERT_EQ(d.erase_if(odd), 2u);
+    container e;
+    e.push_back(1);
+    ASSERT_EQ(e.erase_if(odd), 1u);
+    ASSERT_TRUE(e.empty());
+    ASSERT_EQ(e.erase_if(odd), 0u);
+  });
+}
+
+namespace {
+  struct copy_counter {
+    static size_t copies;
+
+    copy_counter() = default;
+
+    copy_counter(copy_counter const&) {
+      ++copies;
+    }
+
+    copy_counter& operator=(copy_counter const&) = default;
+  };
+
+  size_t copy_counter::copies = 0;
+}
+
+TEST(my_tests, shared_truncation_copies_kept_only) {
+  vector<copy_counter> v(100);
+  copy_counter::copies = 0;
+  auto w = v;
+  w.resize(10);
+  ASSERT_EQ(copy_counter::copies, 10u);
+  w = v;
+  w.pop_back();
+  ASSERT_EQ(copy_counter::copies, 109u);
+  w = v;
+  w.erase(w.cbegin() + 5, w.cend());
+  ASSERT_EQ(copy_counter::copies, 114u);
+  w = v;
+  w.clear();
+  ASSERT_EQ(copy_counter::copies, 114u);
+  ASSERT_TRUE(w.empty());
+  ASSERT_EQ(v.size(), 100u);
+}
+
+TEST(my_tests, shared_growth_copies_once) {
+  vector<copy_counter> v(4);
+  ASSERT_EQ(v.capacity(), 4u);
+  copy_counter::copies = 0;
+  auto w = v;
+  w.emplace_back();
+  ASSERT_EQ(copy_counter::copies, 4u);
+  ASSERT_EQ(w.size(), 5u);
+  w = v;
+  w.reserve(100);
+  ASSERT_EQ(copy_counter::copies, 8u);
+  ASSERT_EQ(w.capacity(), 100u);
+  vector<copy_counter> e;
+  e.emplace_back();
+  e.reserve(10);
+  ASSERT_EQ(e.capacity(), 10u);
+  ASSERT_EQ(e.size(), 1u);
+}
+
+TEST(my_tests, bulk_construction) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    container c(100, 7);
+    ASSERT_EQ(c.size(), 100u);
+    ASSERT_EQ(c.capacity(), 100u);
+    for (auto const& x : std::as_const(c)) {
+      ASSERT_EQ(x, 7);
+    }
+    c.push_back(8, 50);
+    ASSERT_EQ(c.size(), 150u);
+    ASSERT_EQ(c[149], 8);
+    container d(c.cbegin() + 90, c.cend());
+    ASSERT_EQ(d.capacity(), 60u);
+    ASSERT_EQ(d[9], 7);
+    ASSERT_EQ(d[10], 8);
+    container_int ci(1000);
+    ASSERT_EQ(ci.capacity(), 1000u);
+    ci.resize(2000);
+    ASSERT_EQ(ci.size(), 2000u);
+    for (int x : std::as_const(ci)) {
+      ASSERT_EQ(x, 0);
+    }
+  });
+}
+
+TEST(my_tests, input_iterator_constructor) {
+  faulty_run([] {
+    std::istringstream in("1 2 3 4 5 6 7 8 9 10");
+    container_int c{std::istream_iterator<int>(in),
+                    std::istream_iterator<int>()};
+    ASSERT_EQ(c.size(), 10u);
+    for (int i = 0; i != 10; ++i) {
+      ASSERT_EQ(c[i], i + 1);
+    }
+  });
+}
+
+namespace {
+  struct counting_resource : std::pmr::memory_resource {
+    size_t allocated = 0;
+    size_t deallocated = 0;
+
+   private:
+    void* do_allocate(size_t bytes, size_t align) override {
+      void* p = std::pmr::new_delete_resource()->allocate(bytes, align);
+      allocated += bytes;
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % align, 0u);
+      return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+      deallocated += bytes;
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(memory_resource const& other) const noexcept override {
+      return this == &other;
+    }
+  };
+}
+
+TEST(my_tests, pmr_vector) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    counting_resource res;
+    {
+      pmr::vector<counted> v(&res);
+      for (int i = 0; i != 100; ++i) {
+        v.push_back(i);
+      }
+      ASSERT_GT(res.allocated, 100 * sizeof(counted));
+      auto w = v;
+      w.push_back(100);
+      ASSERT_EQ(w.get_allocator().resource(),
+                std::pmr::get_default_resource());
+      pmr::vector<counted> x(10, 5, &res);
+      ASSERT_EQ(x[9], 5);
+    }
+    ASSERT_EQ(res.allocated, res.deallocated);
+  });
+}
+
+TEST(my_tests, pmr_vector_assign) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    counting_resource res, other;
+    {
+      pmr::vector<counted> a(20, 1, &res);
+      pmr::vector<counted> b(std::move(a));
+      ASSERT_EQ(b.get_allocator().resource(), &res);
+      ASSERT_EQ(b.size(), 20u);
+      pmr::vector<counted> c(&other);
+      c = b;
+      ASSERT_EQ(c.get_allocator().resource(), &other);
+      ASSERT_GT(other.allocated, 0u);
+      ASSERT_EQ(c[19], 1);
+      c.push_back(2);
+      ASSERT_EQ(b.size(), 20u);
+      pmr::vector<counted> d(&other);
+      size_t other_allocated = other.allocated;
+      d = std::move(c);
+      ASSERT_EQ(other.allocated, other_allocated);
+      ASSERT_EQ(d.get_allocator().resource(), &other);
+      ASSERT_EQ(d.back(), 2);
+      size_t res_allocated = res.allocated;
+      swap(b, d);
+      ASSERT_EQ(b.get_allocator().resource(), &res);
+      ASSERT_GT(res.allocated, res_allocated);
+      ASSERT_EQ(b.size(), 21u);
+      ASSERT_EQ(d.size(), 20u);
+      std::vector<int> src{3, 4, 5};
+      d.assign(src.begin(), src.end());
+      ASSERT_EQ(d.get_allocator().resource(), &other);
+      ASSERT_EQ(d[2], 5);
+      vector_slice<counted, 1, plain_ref_count,
+              std::pmr::polymorphic_allocator<counted>> s(b, 1, 3);
+      s[0] = 7;
+      ASSERT_EQ(std::as_const(s)[0], 7);
+      ASSERT_EQ(std::as_const(b)[1], 1);
+    }
+    ASSERT_EQ(res.allocated, res.deallocated);
+    ASSERT_EQ(other.allocated, other.deallocated);
+  });
+}
+
+TEST(my_tests, pmr_released_source) {
+  faulty_run([] {
+    counting_resource lng;
+    {
+      pmr::vector<int> keep(&lng);
+      pmr::vector<int> moved(&lng);
+      pmr::vector<int> copied;
+      {
+        std::pmr::monotonic_buffer_resource req;
+        pmr::vector<int> tmp(&req);
+        for (int i = 0; i != 100; ++i) {
+          tmp.push_back(i);
+        }
+        keep = tmp;
+        copied = pmr::vector<int>(tmp);
+        moved = std::move(tmp);
+      }
+      ASSERT_GT(lng.allocated, 0u);
+      keep.push_back(42);
+      moved.push_back(43);
+      copied.push_back(44);
+      ASSERT_EQ(keep[99], 99);
+      ASSERT_EQ(keep[100], 42);
+      ASSERT_EQ(moved[50], 50);
+      ASSERT_EQ(moved[100], 43);
+      ASSERT_EQ(copied[0], 0);
+      ASSERT_EQ(copied[100], 44);
+    }
+    ASSERT_EQ(lng.allocated, lng.deallocated);
+  });
+}
+
+TEST(my_tests, pmr_monotonic_buffer) {
+  alignas(std::max_align_t) char buf[4096];
+  std::pmr::monotonic_buffer_resource arena(buf, sizeof buf,
+                                            std::pmr::null_memory_resource());
+  pmr::vector<int> v(&arena);
+  for (int i = 0; i != 100; ++i) {
+    v.push_back(i);
+  }
+  ASSERT_EQ(v[99], 99);
+  ASSERT_EQ(sizeof(vector<int>), sizeof(std::variant<std::monostate, int,
+                                                     basic_vector<int>>));
+}
+
+TEST(my_tests, growth_policies) {
+  faulty_run([] {
+    vector<int, 1, plain_ref_count, std::allocator<int>, one_and_half_growth> v;
+    std::vector<size_t> caps;
+    for (int i = 0; i != 20; ++i) {
+      v.push_back(i);
+      if (caps.empty() || caps.back() != v.capacity()) {
+        caps.push_back(v.capacity());
+      }
+    }
+    ASSERT_EQ(caps, (std::vector<size_t>{1, 4, 6, 9, 13, 19, 28}));
+    for (int i = 0; i != 20; ++i) {
+      ASSERT_EQ(v[i], i);
+    }
+  });
+}
+
+TEST(my_tests, size_class_growth) {
+  using growth = size_class_growth<>;
+  ASSERT_EQ(growth::size_class(1), 16u);
+  ASSERT_EQ(growth::size_class(128), 128u);
+  ASSERT_EQ(growth::size_class(129), 160u);
+  ASSERT_EQ(growth::size_class(257), 320u);
+  ASSERT_EQ(growth::size_class(1 << 20), size_t(1) << 20);
+  ASSERT_EQ(growth::size_class((1 << 20) + 1), (size_t(5) << 18));
+  for (size_t cap = 1; cap != 1000; ++cap) {
+    size_t next = growth::grow(cap, cap + 1, 24, 12);
+    ASSERT_GE(next, 2 * cap);
+    ASSERT_LT(growth::size_class(24 + next * 12), 24 + (next + 1) * 12);
+  }
+  vector<int, 1, plain_ref_count, std::allocator<int>, growth> v;
+  for (int i = 0; i != 1000; ++i) {
+    v.push_back(i);
+    ASSERT_LE(v.size(), v.capacity());
+  }
+  ASSERT_EQ(v[999], 999);
+}
+
+TEST(my_tests, inline_capacity) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    vector<counted, 4> c;
+    ASSERT_EQ(c.capacity(), 4u);
+    for (int i = 0; i != 4; ++i) {
+      c.push_back(i);
+      ASSERT_EQ(c.capacity(), 4u);
+    }
+    auto d = c;
+    c.insert(c.begin() + 1, 10);
+    ASSERT_EQ(c.size(), 5u);
+    ASSERT_EQ(c.capacity(), 8u);
+    ASSERT_EQ(c[0], 0);
+    ASSERT_EQ(c[1], 10);
+    ASSERT_EQ(c[4], 3);
+    d.erase(d.begin() + 1);
+    ASSERT_EQ(d.size(), 3u);
+    ASSERT_EQ(d[1], 2);
+    d.insert(d.begin(), 2, 7);
+    ASSERT_EQ(d.capacity(), 8u);
+    d.pop_back();
+    d.pop_back();
+    ASSERT_EQ(d.size(), 3u);
+    ASSERT_EQ(d[0], 7);
+    ASSERT_EQ(d[2], 0);
+
+    vector<counted, 4> e;
+    e.insert(e.end(), {1, 2, 3});
+    e.emplace(e.begin() + 1, 5);
+    ASSERT_EQ(e.capacity(), 4u);
+    ASSERT_EQ(e[0], 1);
+    ASSERT_EQ(e[1], 5);
+    ASSERT_EQ(e[3], 3);
+    auto not_five = [](counted const& x) { return x != 5; };
+    ASSERT_EQ(e.erase_if(not_five), 3u);
+    ASSERT_EQ(e.size(), 1u);
+    e.resize(3, 4);
+    ASSERT_EQ(e[2], 4);
+    swap(d, e);
+    ASSERT_EQ(d.size(), 3u);
+    ASSERT_EQ(e.size(), 3u);
+    e = d;
+    ASSERT_TRUE(e == d);
+    e.reserve(10);
+    ASSERT_EQ(e.capacity(), 10u);
+    ASSERT_TRUE(e == d);
+    e.clear();
+    d.erase(d.begin(), d.end());
+    ASSERT_TRUE(d.empty());
+  });
+}
+
+TEST(my_tests, inline_capacity_size) {
+  ASSERT_EQ(sizeof(vector<char, 1>), sizeof(vector<char>));
+  ASSERT_LE(sizeof(vector<char, 8>), 3 * sizeof(void*));
+  ASSERT_LE(sizeof(vector<int, 3>),
+            std::max(sizeof(void*), sizeof(small_buffer<int, 3>)) +
+            std::max(sizeof(void*), alignof(int)));
+  ASSERT_LE(sizeof(vector<long double, 2>),
+            std::max(sizeof(void*), sizeof(small_buffer<long double, 2>)) +
+            std::max(sizeof(void*), alignof(long double)));
+  vector<std::string, 3> v(3, "abc");
+  ASSERT_EQ(v.capacity(), 3u);
+  v.push_back("d");
+  ASSERT_EQ(v.capacity(), 6u);
+  ASSERT_EQ(v[3], "d");
+}
+
+TEST(my_tests, compact_vector) {
+  faulty_run([] {
+    ASSERT_EQ(sizeof(compact_vector<int>), sizeof(void*));
+    ASSERT_EQ(sizeof(compact_vector<double>), sizeof(void*));
+    compact_vector<int> c;
+    ASSERT_TRUE(c.empty());
+    ASSERT_EQ(c.capacity(), 1u);
+    c.push_back(-1);
+    ASSERT_EQ(c.size(), 1u);
+    ASSERT_EQ(c.capacity(), 1u);
+    ASSERT_EQ(c[0], -1);
+    auto d = c;
+    c.push_back(2);
+    c.insert(c.begin(), 3);
+    ASSERT_EQ(c.size(), 3u);
+    ASSERT_EQ(c[0], 3);
+    ASSERT_EQ(c[1], -1);
+    ASSERT_EQ(c[2], 2);
+    ASSERT_EQ(d.size(), 1u);
+    d = c;
+    ASSERT_TRUE(c == d);
+    d[0] = 5;
+    ASSERT_EQ(c[0], 3);
+    ASSERT_TRUE(c < d);
+    d.erase(d.begin(), d.begin() + 2);
+    ASSERT_EQ(d.size(), 1u);
+    ASSERT_EQ(d[0], 2);
+    c.resize(10, 7);
+    ASSERT_EQ(c[9], 7);
+    c.pop_back();
+    ASSERT_EQ(c.size(), 9u);
+    c.clear();
+    ASSERT_TRUE(c.empty());
+    c.push_back(0);
+    ASSERT_EQ(c.size(), 1u);
+    ASSERT_EQ(c[0], 0);
+    swap(c, d);
+    ASSERT_EQ(c[0], 2);
+    ASSERT_EQ(d[0], 0);
+
+    compact_vector<double> e;
+    e.push_back(1.5);
+    ASSERT_EQ(e.capacity(), 4u);
+    compact_vector<double> f(std::move(e));
+    ASSERT_TRUE(e.empty());
+    ASSERT_EQ(f.back(), 1.5);
+  });
+}
+
+TEST(my_tests, compact_vector_aliasing) {
+  faulty_run([] {
+    compact_vector<int> c;
+    c.push_back(42);
+    c.resize(3, c.front());
+    ASSERT_EQ(c.size(), 3u);
+    ASSERT_EQ(c[0], 42);
+    ASSERT_EQ(c[1], 42);
+    ASSERT_EQ(c[2], 42);
+    compact_vector<int> d;
+    d.push_back(7);
+    d.insert(d.cbegin(), d[0]);
+    ASSERT_EQ(d.size(), 2u);
+    ASSERT_EQ(d[0], 7);
+    ASSERT_EQ(d[1], 7);
+    d.insert(d.cbegin() + 1, d[1]);
+    ASSERT_EQ(d[1], 7);
+  });
+}
+
+TEST(my_tests, mutable_span) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    container c(5, 1);
+    container d = c;
+    auto s = c.mutable_span();
+    ASSERT_EQ(s.size(), 5u);
+    for (auto& x : s) {
+      x = x * 2;
+    }
+    s[4] = 7;
+    ASSERT_EQ(c[0], 2);
+    ASSERT_EQ(c[4], 7);
+    ASSERT_EQ(d[0], 1);
+    ASSERT_EQ(d[4], 1);
+    container_int v(100, 1);
+    container_int w = v;
+    v.mutate([](int* p, size_t n) {
+      for (size_t i = 0; i != n; ++i) {
+        p[i] += int(i);
+      }
+    });
+    ASSERT_EQ(v[99], 100);
+    ASSERT_EQ(w[99], 1);
+    container e;
+    ASSERT_EQ(e.mutable_span().size(), 0u);
+  });
+}
+
+TEST(my_tests, chunked_vector) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    chunked_vector<counted, 4> c;
+    for (int i = 0; i != 10; ++i) {
+      c.push_back(i);
+    }
+    ASSERT_EQ(c.size(), 10u);
+    ASSERT_EQ(c.chunk_count(), 3u);
+    ASSERT_EQ(c.chunk(2).size(), 2u);
+    auto d = c;
+    d[5] = 50;
+    ASSERT_EQ(c[5], 5);
+    ASSERT_EQ(d[5], 50);
+    ASSERT_EQ(c.chunk(0).data(), d.chunk(0).data());
+    ASSERT_NE(c.chunk(1).data(), d.chunk(1).data());
+    ASSERT_EQ(c.chunk(2).data(), d.chunk(2).data());
+    d.push_back(10);
+    ASSERT_EQ(c.size(), 10u);
+    ASSERT_EQ(d.back(), 10);
+    ASSERT_EQ(c.chunk(0).data(), d.chunk(0).data());
+    d.pop_back();
+    d.pop_back();
+    d.pop_back();
+    ASSERT_EQ(d.chunk_count(), 2u);
+    ASSERT_EQ(c.back(), 9);
+    ASSERT_FALSE(c == d);
+    d[5] = 5;
+    d.push_back(8);
+    d.push_back(9);
+    ASSERT_TRUE(c == d);
+    int expected = 0;
+    for (auto const& x : c) {
+      ASSERT_EQ(x, expected++);
+    }
+    ASSERT_EQ(std::accumulate(c.begin(), c.end(), 0), 45);
+    auto e = d;
+    d.clear();
+    ASSERT_TRUE(d.empty());
+    ASSERT_EQ(e.size(), 10u);
+    ASSERT_EQ(std::as_const(e)[9], 9);
+    c.clear();
+    ASSERT_TRUE(c.empty());
+    ASSERT_EQ(e.size(), 10u);
+  });
+}
+
+TEST(my_tests, chunked_vector_fill) {
+  faulty_run([] {
+    chunked_vector<int, 64> c(1000, 3);
+    ASSERT_EQ(c.chunk_count(), 16u);
+    auto d = c;
+    auto s = d.mutable_chunk(15);
+    for (auto& x : s) {
+      x = 4;
+    }
+    auto const& cd = d;
+    ASSERT_EQ(c[999], 3);
+    ASSERT_EQ(cd[999], 4);
+    ASSERT_EQ(cd[959], 3);
+    ASSERT_EQ(c.chunk(14).data(), d.chunk(14).data());
+    chunked_vector<double, 64> n(100, std::numeric_limits<double>::quiet_NaN());
+    auto m = n;
+    ASSERT_FALSE(n == m);
+  });
+}
+
+TEST(my_tests, chunked_vector_assign) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    chunked_vector<counted, 4> a, b;
+    a.push_back(1);
+    b.push_back(5);
+    b = a;
+    b[0] = 2;
+    a[0] = 3;
+    auto const& ca = a;
+    auto const& cb = b;
+    ASSERT_EQ(ca[0], 3);
+    ASSERT_EQ(cb[0], 2);
+    b = b;
+    a = std::move(b);
+    ASSERT_EQ(ca[0], 2);
+  });
+}
+
+TEST(my_tests, vector_slice) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    container c;
+    for (int i = 0; i != 10; ++i) {
+      c.push_back(i);
+    }
+    vector_slice const s(c, 2, 5);
+    ASSERT_EQ(s.size(), 5u);
+    ASSERT_EQ(s.begin(), c.cbegin() + 2);
+    ASSERT_EQ(s[0], 2);
+    ASSERT_EQ(s.back(), 6);
+    auto t = s.subslice(1, 3);
+    ASSERT_EQ(std::as_const(t).begin(), c.cbegin() + 3);
+    ASSERT_EQ(std::as_const(t).front(), 3);
+    t[0] = 30;
+    ASSERT_EQ(t.size(), 3u);
+    ASSERT_EQ(t[0], 30);
+    ASSERT_EQ(t[2], 5);
+    ASSERT_EQ(c[3], 3);
+    ASSERT_EQ(s[1], 3);
+    container d = t.to_vector();
+    ASSERT_EQ(d.size(), 3u);
+    ASSERT_EQ(d[0], 30);
+    vector_slice const whole(c);
+    ASSERT_EQ(whole.to_vector().cbegin(), c.cbegin());
+    ASSERT_TRUE(whole.subslice(2, 5) == s);
+    ASSERT_FALSE(t == s);
+  });
+}
+
+TEST(my_tests, vector_slice_outlives_vector) {
+  faulty_run([] {
+    vector_slice<std::string> s;
+    {
+      vector<std::string> v(5, "abc");
+      s = vector_slice(v, 3, 2);
+    }
+    std::string const* p = std::as_const(s).begin();
+    s[0] = "x";
+    ASSERT_EQ(s.begin(), p);
+    ASSERT_EQ(s[0], "x");
+    ASSERT_EQ(s[1], "abc");
+    vector<int> small(1, 7);
+    vector_slice e(small, 0, 1);
+    e[0] = 8;
+    ASSERT_EQ(small[0], 7);
+    ASSERT_EQ(e[0], 8);
+  });
+}
+
+TEST(my_tests, persistent_vector) {
+  faulty_run([] {
+    counted::no_new_instances_guard g;
+    using pvector = persistent_vector<counted, plain_ref_count, 2>;
+    pvector v;
+    std::vector<pvector> versions;
+    for (int i = 0; i != 40; ++i) {
+      versions.push_back(v);
+      v = v.push_back(i);
+    }
+    ASSERT_EQ(v.size(), 40u);
+    for (size_t i = 0; i != versions.size(); ++i) {
+      ASSERT_EQ(versions[i].size(), i);
+    }
+    ASSERT_EQ(versions[20].back(), 19);
+    auto w = v.set(17, 100);
+    ASSERT_EQ(w[17], 100);
+    ASSERT_EQ(v[17], 17);
+    auto s = w.slice(5, 23);
+    ASSERT_EQ(s.size(), 18u);
+    ASSERT_EQ(s.front(), 5);
+    ASSERT_EQ(s[12], 100);
+    ASSERT_EQ(s.back(), 22);
+    auto c = concat(s, versions[7]);
+    ASSERT_EQ(c.size(), 25u);
+    ASSERT_EQ(c[17], 22);
+    ASSERT_EQ(c[18], 0);
+    ASSERT_EQ(c.back(), 6);
+    auto p = c.pop_back();
+    ASSERT_EQ(p.back(), 5);
+    ASSERT_EQ(c.back(), 6);
+    auto t = p.transient();
+    for (int i = 0; i != 10; ++i) {
+      t.push_back(i);
+      t.set(0, i);
+    }
+    t.pop_back();
+    auto q = t.persistent();
+    t.set(1, -1);
+    ASSERT_EQ(q.size(), 33u);
+    ASSERT_EQ(q[0], 9);
+    ASSERT_EQ(q[1], 6);
+    ASSERT_EQ(q.back(), 8);
+    ASSERT_EQ(t[1], -1);
+    ASSERT_EQ(p[0], 5);
+  });
+}
+
+TEST(my_tests, persistent_vector_concat_slice) {
+  using pvector = persistent_vector<int, plain_ref_count, 2>;
+  std::mt19937 gen(42);
+  std::vector<pvector> pool;
+  std::vector<std::vector<int>> expected;
+  for (int i = 0; i != 8; ++i) {
+    size_t n = gen() % 70;
+    std::vector<int> e(n);
+    std::iota(e.begin(), e.end(), i * 100);
+    pool.emplace_back(e.begin(), e.end());
+    expected.push_back(e);
+  }
+  for (int step = 0; step != 300; ++step) {
+    size_t a = gen() % pool.size();
+    size_t b = gen() % pool.size();
+    pvector next;
+    std::vector<int> e;
+    switch (gen() % 3) {
+      case 0: {
+        next = concat(pool[a], pool[b]);
+        e = expected[a];
+        e.insert(e.end(), expected[b].begin(), expected[b].end());
+        break;
+      }
+      case 1: {
+        size_t n = expected[a].size();
+        size_t first = n ? gen() % (n + 1) : 0;
+        size_t last = first + (n - first ? gen() % (n - first + 1) : 0);
+        next = pool[a].slice(first, last);
+        e.assign(expected[a].begin() + first, expected[a].begin() + last);
+        break;
+      }
+      default: {
+        next = pool[a].push_back(step);
+        e = expected[a];
+        e.push_back(step);
+        if (!e.empty()) {
+          size_t at = gen() % e.size();
+          next = next.set(at, -step);
+          e[at] = -step;
+        }
+      }
+    }
+    if (e.size() > 2000) {
+      continue;
+    }
+    ASSERT_EQ(next.size(), e.size());
+    ASSERT_TRUE(std::equal(next.begin(), next.end(), e.begin()));
+    pool.push_back(next);
+    expected.push_back(e);
+    if (pool.size() > 16) {
+      size_t k = gen() % pool.size();
+      pool.erase(pool.begin() + k);
+      expected.erase(expected.begin() + k);
+    }
+    for (size_t i = 0; i != pool.size(); ++i) {
+      ASSERT_TRUE(std::equal(pool[i].begin(), pool[i].end(),
+                             expected[i].begin(), expected[i].end()));
+    }
+  }
+}
+
+TEST(my_tests, resize_for_overwrite) {
+  faulty_run([] {
+    container_int v{1, 2, 3};
+    auto w = v;
+    v.resize_for_overwrite(1000);
+    ASSERT_EQ(v.size(), 1000u);
+    ASSERT_EQ(v[2], 3);
+    std::iota(v.begin() + 3, v.end(), 4);
+    ASSERT_EQ(v[999], 1000);
+    ASSERT_EQ(w.size(), 3u);
+    v.resize_for_overwrite(10);
+    ASSERT_EQ(v.size(), 10u);
+    ASSERT_EQ(v[9], 10);
+    v.append_uninitialized(5);
+    ASSERT_EQ(v.size(), 15u);
+    ASSERT_EQ(v[9], 10);
+    container_int e;
+    e.resize_for_overwrite(1);
+    ASSERT_EQ(e.size(), 1u);
+    e.append_uninitialized(0);
+    ASSERT_EQ(e.size(), 1u);
+    vector<char, 8> s;
+    s.append_uninitialized(8);
+    ASSERT_EQ(s.capacity(), 8u);
+    s.append_uninitialized(8);
+    ASSERT_EQ(s.size(), 16u);
+  });
+}
+
+TEST(my_tests, byte_compare) {
+  std::mt19937 gen(7);
+  for (size_t n : {0, 1, 7, 15, 16, 17, 31, 32, 33, 100, 1000}) {
+    std::vector<unsigned char> a(n);
+    for (auto& x : a) {
+      x = gen();
+    }
+    for (size_t at = 0; at != n; ++at) {
+      auto b = a;
+      b[at] ^= 1;
+      ASSERT_EQ(first_mismatch(a.data(), b.data(), n), at);
+      ASSERT_EQ(first_mismatch_scalar(a.data(), b.data(), n), at);
+#ifdef BYTE_COMPARE_X86
+      ASSERT_EQ(first_mismatch_sse2(a.data(), b.data(), n), at);
+#endif
+    }
+    ASSERT_EQ(first_mismatch(a.data(), a.data() + 0, n), n);
+  }
+}
+
+TEST(my_tests, vector_compare) {
+  faulty_run([] {
+    container_int a(100, 5);
+    container_int b(100, 5);
+    ASSERT_TRUE(a == b);
+    ASSERT_FALSE(a < b);
+    b[57] = 6;
+    ASSERT_FALSE(a == b);
+    ASSERT_TRUE(a < b);
+    a[57] = -1;
+    ASSERT_TRUE(a < b);
+    ASSERT_FALSE(b < a);
+    a[57] = 256;
+    ASSERT_TRUE(b < a);
+    auto c = a;
+    ASSERT_TRUE(c == a);
+    ASSERT_FALSE(c < a);
+    c.pop_back();
+    ASSERT_TRUE(c < a);
+    ASSERT_TRUE(container_int() < c);
+    ASSERT_TRUE(container_int() == container_int());
+    vector<std::string> s{"a", "b"};
+    vector<std::string> t{"a", "c"};
+    ASSERT_TRUE(s < t);
+    ASSERT_FALSE(s == t);
+    vector<double> d(10, std::numeric_limits<double>::quiet_NaN());
+    auto e = d;
+    ASSERT_FALSE(d == e);
+    ASSERT_FALSE(d == d);
+    ASSERT_FALSE(d < e);
+  });
+}
+
+TEST(my_tests, cached_hash) {
+  vector<hash_counted> v(100, hash_counted{1});
+  auto w = v;
+  hash_counted::hashes = 0;
+  size_t h = std::hash<vector<hash_counted>>()(v);
+  ASSERT_EQ(hash_counted::hashes, 100u);
+  ASSERT_EQ(std::hash<vector<hash_counted>>()(w), h);
+  ASSERT_EQ(std::as_const(v).hash(), h);
+  ASSERT_EQ(hash_counted::hashes, 100u);
+  w[0].value = 2;
+  ASSERT_NE(w.hash(), h);
+  ASSERT_EQ(v.hash(), h);
+  ASSERT_EQ(hash_counted::hashes, 200u);
+  w[0].value = 1;
+  ASSERT_EQ(w.hash(), h);
+  v.mutable_span()[5].value = 3;
+  ASSERT_NE(v.hash(), h);
+  v.pop_back();
+  v.push_back(hash_counted{1});
+  v.mutable_span()[5].value = 1;
+  ASSERT_EQ(v.hash(), h);
+}
+
+TEST(my_tests, cached_hash_after_writes) {
+  vector<hash_counted> key(100, hash_counted{0});
+  for (size_t i = 0; i != key.size(); ++i) {
+    key[i].value = int(key.size() - i);
+  }
+  std::sort(key.begin(), key.end(), [](auto const& a, auto const& b) {
+    return a.value < b.value;
+  });
+  auto copy = key;
+  hash_counted::hashes = 0;
+  size_t h = copy.hash();
+  for (int i = 0; i != 10; ++i) {
+    ASSERT_EQ(std::hash<vector<hash_counted>>()(copy), h);
+  }
+  ASSERT_EQ(std::as_const(key).hash(), h);
+  ASSERT_EQ(hash_counted::hashes, 100u);
+  key[0].value = 0;
+  ASSERT_NE(key.hash(), h);
+  ASSERT_EQ(copy.hash(), h);
+  ASSERT_EQ(hash_counted::hashes, 200u);
+}
+
+TEST(my_tests, hash_container) {
+  faulty_run([] {
+    std::unordered_set<container_int> set;
+    container_int a(1, 5);
+    container_int b(1000, 5);
+    set.insert(a);
+    set.insert(b);
+    set.insert(b);
+    ASSERT_EQ(set.size(), 2u);
+    container_int c;
+    c.push_back(5);
+    c.push_back(6);
+    c.pop_back();
+    ASSERT_EQ(c.hash(), a.hash());
+    ASSERT_EQ(set.count(c), 1u);
+    ASSERT_EQ(set.count(container_int(999, 5)), 0u);
+  });
+}
+
+TEST(my_tests, hash_retained_reference) {
+  vector<int> v(100, 1);
+  int& r = v[0];
+  auto h = std::hash<vector<int>>()(v);
+  r = 5;
+  vector<int> fresh(v.cbegin(), v.cend());
+  ASSERT_TRUE(v == fresh);
+  ASSERT_NE(std::hash<vector<int>>()(v), h);
+  ASSERT_EQ(std::hash<vector<int>>()(v), std::hash<vector<int>>()(fresh));
+  auto s = v.mutable_span();
+  h = v.hash();
+  s.data()[1] = 7;
+  ASSERT_EQ(v.hash(), vector<int>(v.cbegin(), v.cend()).hash());
+  ASSERT_NE(v.hash(), h);
+  std::unordered_set<vector<int>> set{fresh};
+  ASSERT_EQ(set.count(fresh), 1u);
+  fresh.push_back(2);
+  ASSERT_EQ(set.count(fresh), 0u);
+  fresh.pop_back();
+  ASSERT_EQ(set.count(fresh), 1u);
+}
+
+TEST(my_tests, map_file) {
+  std::string path = std::filesystem::temp_directory_path() /
+                     "vector_map_file_test";
+  container_int v;
+  for (int i = 0; i != 10000; ++i) {
+    v.push_back(i * i);
+  }
+  save_file(path, v);
+  auto m = map_file<container_int>(path);
+  ASSERT_EQ(m.size(), 10000u);
+  ASSERT_TRUE(m == v);
+  auto c = m;
+  ASSERT_EQ(c.cbegin(), m.cbegin());
+  c[5] = -1;
+  ASSERT_NE(c.cbegin(), m.cbegin());
+  ASSERT_EQ(m[5], 25);
+  m.push_back(7);
+  ASSERT_EQ(m.size(), 10001u);
+  ASSERT_EQ(m[9999], 9999 * 9999);
+  ASSERT_EQ(map_file<container_int>(path)[5], 25);
+
+  save_file(path, container_int());
+  ASSERT_TRUE(map_file<container_int>(path).empty());
+  save_file(path, container_int(1, 3));
+  auto one = map_file<container_int>(path);
+  ASSERT_EQ(one.size(), 1u);
+  ASSERT_EQ(one[0], 3);
+
+  using buffer = basic_vector<int, 4, atomic_ref_count>;
+  auto b = map_file<buffer>(path);
+  ASSERT_FALSE(b.unique());
+  ASSERT_EQ(b.capacity(), 1u);
+  {
+    buffer copy = b;
+    ASSERT_FALSE(b.unique());
+  }
+  ASSERT_FALSE(b.unique());
+  b.push_back(4);
+  ASSERT_TRUE(b.unique());
+  ASSERT_EQ(std::as_const(b).size(), 2u);
+
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "short";
+  }
+  ASSERT_THROW(map_file<container_int>(path), std::runtime_error);
+  std::remove(path.c_str());
+  ASSERT_THROW(map_file<container_int>(path), std::system_error);
+}
+
+TEST(my_tests, reallocating_growth) {
+  using alloc = mremap_allocator<int, 4096>;
+  static_assert(has_reallocate<alloc>::value);
+  static_assert(!has_reallocate<std::allocator<int>>::value);
+  vector<int, 1, plain_ref_count, alloc> v;
+  for (int i = 0; i != 100000; ++i) {
+    v.push_back(i);
+  }
+  ASSERT_EQ(v[99999], 99999);
+  for (int i = 0; i != 1000; ++i) {
+    v.push_back(v[0]);
+  }
+  ASSERT_EQ(v.back(), 0);
+  auto w = v;
+  w.push_back(1);
+  ASSERT_EQ(v.size(), 101000u);
+  ASSERT_EQ(w.size(), 101001u);
+  v.resize(v.size() + 100000);
+  ASSERT_EQ(v[50000], 50000);
+  ASSERT_EQ(v.back(), 0);
+  v.resize_for_overwrite(300000);
+  v.resize(10);
+  v.shrink_to_fit();
+  ASSERT_EQ(v.capacity(), 10u);
+  ASSERT_EQ(v[9], 9);
+  v.reserve(5000);
+  ASSERT_EQ(v.capacity(), 5000u);
+  v.insert(v.begin(), 3, -1);
+  ASSERT_EQ(v[2], -1);
+  ASSERT_EQ(v[12], 9);
+}
+
+TEST(my_tests, huge_page_backing) {
+  huge_page_vector<int> v;
+  for (int i = 0; i != 10; ++i) {
+    v.push_back(i);
+  }
+  v.reserve(huge_page_size);
+  auto block = reinterpret_cast<uintptr_t>(v.data()) & ~(huge_page_size - 1);
+  ASSERT_LT(reinterpret_cast<uintptr_t>(v.data()) - block, 4096u);
+  ASSERT_EQ(v[9], 9);
+  v.resize(huge_page_size);
+  ASSERT_EQ(v.back(), 0);
+  auto w = v;
+  w[0] = -1;
+  ASSERT_EQ(v[0], 0);
+  v.resize(10);
+  v.shrink_to_fit();
+  ASSERT_EQ(v.capacity(), 10u);
+  ASSERT_EQ(v[5], 5);
+}
+
+TEST(my_tests, recycled_buffers) {
+  using alloc = recycling_allocator<int, 4096>;
+  using container = vector<int, 1, plain_ref_count, alloc>;
+  alloc::trim();
+  int const* released;
+  {
+    container v(100, 1);
+    released = v.data();
+  }
+  auto cached = alloc::cached_bytes();
+  ASSERT_GT(cached, 0u);
+  {
+    container v(90, 3);
+    ASSERT_EQ(v.data(), released);
+    ASSERT_EQ(v[89], 3);
+    ASSERT_LT(alloc::cached_bytes(), cached);
+  }
+  ASSERT_EQ(alloc::cached_bytes(), cached);
+  {
+    std::vector<container> many(100, container(50, 4));
+    for (auto& v : many) {
+      v.push_back(5);
+    }
+  }
+  ASSERT_LE(alloc::cached_bytes(), 4096u);
+  cached = alloc::cached_bytes();
+  std::vector<std::thread> threads;
+  for (int t = 0; t != 4; ++t) {
+    threads.emplace_back([] {
+      for (int i = 0; i != 1000; ++i) {
+        container v;
+        for (int j = 0; j != i % 50; ++j) {
+          v.push_back(j);
+        }
+        ASSERT_EQ(v.size(), size_t(i % 50));
+      }
+      ASSERT_GT(alloc::cached_bytes(), 0u);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(alloc::cached_bytes(), cached);
+  alloc::trim();
+  ASSERT_EQ(alloc::cached_bytes(), 0u);
+}
+
+namespace {
+  std::atomic<size_t> reclaimed{0};
+  std::atomic<bool> reclaimed_elsewhere{false};
+  std::thread::id test_thread;
+
+  struct reclaim_tracked {
+    ~reclaim_tracked() {
+      ++reclaimed;
+      if (std::this_thread::get_id() != test_thread) {
+        reclaimed_elsewhere = true;
+      }
+    }
+  };
+}
+
+TEST(my_tests, deferred_destruction) {
+  using container = vector<reclaim_tracked, 1,
+                           deferred_release<plain_ref_count, 4096>>;
+  test_thread = std::this_thread::get_id();
+  reclaimed = 0;
+  {
+    container v(10);
+  }
+  ASSERT_EQ(reclaimed, 10u);
+  ASSERT_FALSE(reclaimed_elsewhere);
+  {
+    container v(100000);
+    auto w = v;
+  }
+  background_reclaimer::flush();
+  ASSERT_EQ(reclaimed, 100010u);
+  ASSERT_TRUE(reclaimed_elsewhere);
+  for (int i = 0; i != 1000; ++i) {
+    container v(5000);
+  }
+  background_reclaimer::drain();
+  ASSERT_EQ(reclaimed, 5100010u);
+  deferred_vector<std::string> s(1000000, "snapshot");
+  s = deferred_vector<std::string>();
+  background_reclaimer::flush();
+}
+
+namespace {
+  std::atomic<size_t> parallel_live{0};
+  std::atomic<size_t> parallel_copies{0};
+  std::atomic<size_t> parallel_fail_at{0};
+
+  struct parallel_element {
+    int value = 0;
+    char pad[60] = {};
+
+    parallel_element() {
+      ++parallel_live;
+    }
+
+    parallel_element(parallel_element const& other) : value(other.value) {
+      if (++parallel_copies == parallel_fail_at) {
+        throw std::runtime_error("copy failed");
+      }
+      ++parallel_live;
+    }
+
+    ~parallel_element() {
+      --parallel_live;
+    }
+  };
+}
+
+template <>
+struct is_parallel_constructible<parallel_element> : std::true_type {
+};
+
+TEST(my_tests, parallel_construction) {
+  size_t const n = 3 * parallel_threshold / sizeof(int);
+  vector<int> v(n, 7);
+  ASSERT_EQ(v[0], 7);
+  ASSERT_EQ(v[n - 1], 7);
+  auto w = v;
+  w[n / 2] = 1;
+  ASSERT_EQ(v[n / 2], 7);
+  ASSERT_EQ(w[n / 2 + 1], 7);
+  ASSERT_EQ(w[n - 1], 7);
+  vector<int> r(w.cbegin(), w.cend());
+  ASSERT_TRUE(r == w);
+  vector<int> zeros(n);
+  ASSERT_EQ(zeros[n - 1], 0);
+
+  size_t const m = 2 * parallel_threshold / sizeof(parallel_element);
+  {
+    vector<parallel_element> p(m);
+    for (size_t i = 0; i != m; ++i) {
+      p[i].value = int(i);
+    }
+    ASSERT_EQ(parallel_live, m);
+    auto q = p;
+    parallel_copies = 0;
+    parallel_fail_at = m / 2;
+    ASSERT_THROW(q[0].value = -1, std::runtime_error);
+    ASSERT_EQ(parallel_live, m);
+    ASSERT_EQ(std::as_const(q)[m - 1].value, int(m - 1));
+    parallel_fail_at = 0;
+    q[0].value = -1;
+    ASSERT_EQ(parallel_live, 2 * m);
+    ASSERT_EQ(p[0].value, 0);
+    ASSERT_EQ(q[m - 1].value, int(m - 1));
+  }
+  ASSERT_EQ(parallel_live, 0u);
+}
+
+TEST(my_tests, parallel_construct_rollback) {
+  size_t const n = 1000;
+  std::vector<std::atomic<int>> built(n);
+  auto construct = [&](size_t from, size_t count) {
+    if (from <= n / 2 && n / 2 < from + count) {
+      throw std::runtime_error("chunk failed");
+    }
+    for (size_t i = from; i != from + count; ++i) {
+      ++built[i];
+    }
+  };
+  auto destroy = [&](size_t from, size_t count) {
+    for (size_t i = from; i != from + count; ++i) {
+      --built[i];
+    }
+  };
+  ASSERT_THROW(parallel_construct(n, 4 * parallel_threshold, construct,
+                                  destroy, 4), std::runtime_error);
+  for (auto& b : built) {
+    ASSERT_EQ(b, 0);
+  }
+  parallel_construct(n / 4, 4 * parallel_threshold, construct, destroy, 4);
+  ASSERT_EQ(built[0], 1);
+  ASSERT_EQ(built[n / 4 - 1], 1);
+  ASSERT_EQ(built[n / 4], 0);
+}